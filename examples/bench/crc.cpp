@@ -0,0 +1,48 @@
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+uint32_t crc32(const std::vector<uint8_t>& data) { // bitwise, reflected polynomial 0xEDB88320
+    uint32_t crc = 0xFFFFFFFF;
+    for (auto byte : data) {
+        crc ^= byte;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+std::vector<uint8_t> compress(const std::vector<uint8_t>& data) { // run-length encoding: count, byte
+    std::vector<uint8_t> out;
+    for (std::size_t i = 0; i < data.size(); ) {
+        std::size_t run = 1;
+        while (i + run < data.size() && data[i + run] == data[i] && run < 255) run++;
+        out.push_back(run);
+        out.push_back(data[i]);
+        i += run;
+    }
+    return out;
+}
+
+std::vector<uint8_t> decompress(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> out;
+    for (std::size_t i = 0; i + 1 < data.size(); i += 2) {
+        out.insert(out.end(), data[i], data[i + 1]);
+    }
+    return out;
+}
+
+int main() {
+    std::vector<uint8_t> data(200000);
+    uint32_t seed = 7;
+    for (std::size_t i = 0; i < data.size(); ) { // runs of random length, so that it compresses
+        seed = seed * 1103515245 + 12345;
+        std::size_t run = 1 + (seed >> 16) % 12;
+        for (std::size_t k = 0; k < run && i < data.size(); k++) data[i++] = (seed >> 8) & 0x0F;
+    }
+    auto packed = compress(data);
+    auto unpacked = decompress(packed);
+    std::cout << "crc " << crc32(data) << " packed " << packed.size() << " crc " << crc32(packed)
+              << (unpacked == data ? " roundtrip ok" : " roundtrip failed") << std::endl;
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct entry {
+    std::string key;
+    long value;
+    bool used = false;
+};
+
+class hash_map { // open addressing with linear probing, grown at half load
+public:
+    void put(const std::string& key, long value) {
+        if ((m_size + 1) * 2 > m_slots.size()) grow();
+        auto& e = m_slots[find(key)];
+        if (!e.used) m_size++;
+        e.key = key;
+        e.value = value;
+        e.used = true;
+    }
+
+    long get(const std::string& key) const {
+        const auto& e = m_slots[find(key)];
+        return e.used ? e.value : -1;
+    }
+
+    std::size_t size() const { return m_size; }
+private:
+    static uint64_t hash(const std::string& key) {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : key) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    std::size_t find(const std::string& key) const {
+        std::size_t i = hash(key) % m_slots.size();
+        while (m_slots[i].used && m_slots[i].key != key) i = (i + 1) % m_slots.size();
+        return i;
+    }
+
+    void grow() {
+        std::vector<entry> old;
+        old.swap(m_slots);
+        m_slots.resize(old.empty() ? 16 : old.size() * 2);
+        m_size = 0;
+        for (const auto& e : old) {
+            if (e.used) put(e.key, e.value);
+        }
+    }
+
+    std::vector<entry> m_slots;
+    std::size_t m_size = 0;
+};
+
+int main() {
+    hash_map map;
+    for (long i = 0; i < 20000; i++) {
+        map.put("key" + std::to_string(i * 7919 % 30011), i);
+    }
+    long sum = 0, missing = 0;
+    for (long i = 0; i < 30011; i++) {
+        long v = map.get("key" + std::to_string(i));
+        if (v < 0) missing++;
+        else sum += v;
+    }
+    std::cout << "size " << map.size() << " sum " << sum << " missing " << missing << std::endl;
+}
@@ -0,0 +1,17 @@
+#include <iostream>
+#include <cstdint>
+
+uint64_t step(uint64_t state, uint64_t i) { // one round of a xorshift generator, mixed with the counter
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state + i;
+}
+
+int main() {
+    uint64_t state = 88172645463325252ull;
+    for (uint64_t i = 0; i < 50000000; i++) {
+        state = step(state, i);
+    }
+    std::cout << "state " << state << std::endl;
+}
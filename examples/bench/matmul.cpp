@@ -0,0 +1,35 @@
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+const int N = 96;
+
+void fill(std::vector<double>& m, uint32_t seed) { // deterministic, so that every run computes the same product
+    for (auto& x : m) {
+        seed = seed * 1103515245 + 12345;
+        x = (seed >> 16) % 100 / 10.0;
+    }
+}
+
+void multiply(const std::vector<double>& a, const std::vector<double>& b, std::vector<double>& c) {
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            double sum = 0;
+            for (int k = 0; k < N; k++) {
+                sum += a[i * N + k] * b[k * N + j];
+            }
+            c[i * N + j] = sum;
+        }
+    }
+}
+
+int main() {
+    std::vector<double> a(N * N), b(N * N), c(N * N);
+    fill(a, 1);
+    fill(b, 2);
+    multiply(a, b, c);
+    double trace = 0, total = 0;
+    for (int i = 0; i < N; i++) trace += c[i * N + i];
+    for (auto x : c) total += x;
+    std::cout << "trace " << trace << " total " << total << std::endl;
+}
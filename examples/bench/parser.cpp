@@ -0,0 +1,65 @@
+#include <iostream>
+#include <string>
+#include <cctype>
+#include <cstdint>
+
+struct parser { // recursive descent over integer expressions: + - * / and parentheses
+    const std::string& text;
+    std::size_t pos = 0;
+
+    long expression() {
+        long value = term();
+        while (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+            char op = text[pos++];
+            long rhs = term();
+            value = op == '+' ? value + rhs : value - rhs;
+        }
+        return value;
+    }
+
+    long term() {
+        long value = factor();
+        while (pos < text.size() && (text[pos] == '*' || text[pos] == '/')) {
+            char op = text[pos++];
+            long rhs = factor();
+            value = op == '*' ? value * rhs % 1000003 : rhs != 0 ? value / rhs : 0; // bounded, so that it never overflows
+        }
+        return value;
+    }
+
+    long factor() {
+        if (text[pos] == '(') {
+            pos++;
+            long value = expression();
+            pos++; // ')'
+            return value;
+        }
+        long value = 0;
+        while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) {
+            value = value * 10 + (text[pos++] - '0');
+        }
+        return value;
+    }
+};
+
+std::string generate(uint32_t& seed, int depth) { // random, but the same on every run
+    seed = seed * 1103515245 + 12345;
+    if (depth == 0 || (seed >> 16) % 3 == 0) return std::to_string((seed >> 8) % 1000);
+    const char ops[] = "+-*/";
+    auto lhs = generate(seed, depth - 1);
+    auto rhs = generate(seed, depth - 1);
+    return "(" + lhs + ops[(seed >> 4) % 4] + rhs + ")";
+}
+
+int main() {
+    uint32_t seed = 3;
+    long sum = 0;
+    std::size_t characters = 0;
+    for (int i = 0; i < 2000; i++) {
+        auto text = generate(seed, 8);
+        parser p {text};
+        sum += p.expression();
+        characters += text.size();
+    }
+    std::cout << "parsed " << characters << " characters, sum " << sum << std::endl;
+}
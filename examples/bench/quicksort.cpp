@@ -0,0 +1,40 @@
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+int partition(std::vector<int>& v, int low, int high) {
+    int pivot = v[(low + high) / 2];
+    int i = low, j = high;
+    while (true) {
+        while (v[i] < pivot) i++;
+        while (v[j] > pivot) j--;
+        if (i >= j) return j;
+        std::swap(v[i], v[j]);
+        i++;
+        j--;
+    }
+}
+
+void quicksort(std::vector<int>& v, int low, int high) {
+    if (low >= high) return;
+    int p = partition(v, low, high);
+    quicksort(v, low, p);
+    quicksort(v, p + 1, high);
+}
+
+int main() {
+    std::vector<int> v(100000);
+    uint32_t seed = 42;
+    for (auto& x : v) {
+        seed = seed * 1103515245 + 12345;
+        x = seed >> 8;
+    }
+    quicksort(v, 0, v.size() - 1);
+    bool sorted = true;
+    uint64_t checksum = 0;
+    for (std::size_t i = 0; i < v.size(); i++) {
+        if (i > 0 && v[i - 1] > v[i]) sorted = false;
+        checksum = checksum * 31 + v[i];
+    }
+    std::cout << (sorted ? "sorted" : "unsorted") << " checksum " << checksum << std::endl;
+}
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+const int n_threads = 4;
+
+uint64_t reduce(const std::vector<uint32_t>& data, std::size_t begin, std::size_t end) {
+    uint64_t sum = 0;
+    for (std::size_t i = begin; i < end; i++) {
+        sum += data[i] % 1000;
+    }
+    return sum;
+}
+
+int main() {
+    std::vector<uint32_t> data(4000000);
+    uint32_t seed = 11;
+    for (auto& x : data) {
+        seed = seed * 1103515245 + 12345;
+        x = seed;
+    }
+    std::vector<uint64_t> partial(n_threads);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < n_threads; t++) { // each thread adds up its own slice, the main thread adds up their sums
+        threads.emplace_back([&, t] {
+            partial[t] = reduce(data, data.size() * t / n_threads, data.size() * (t + 1) / n_threads);
+        });
+    }
+    partial[0] = reduce(data, 0, data.size() / n_threads); // the first slice is the main thread's: SOFI only traces that one
+    uint64_t total = partial[0];
+    for (int t = 1; t < n_threads; t++) {
+        threads[t - 1].join();
+        total += partial[t];
+    }
+    std::cout << "total " << total << std::endl;
+}
@@ -0,0 +1,27 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdint>
+
+void write_records(std::ofstream& out, int count) { // one line per record, flushed often so that the writes reach the kernel
+    uint32_t seed = 5;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        out << i << "," << seed << "," << (seed >> 16) % 97 << "\n";
+        if (i % 64 == 0) out.flush();
+    }
+}
+
+int main() {
+    std::ofstream out {"bench_writer.out"};
+    write_records(out, 200000);
+    out.close();
+    std::ifstream in {"bench_writer.out"};
+    std::string line;
+    uint64_t lines = 0, checksum = 0;
+    while (std::getline(in, line)) {
+        lines++;
+        for (char c : line) checksum = checksum * 131 + c;
+    }
+    std::cout << "lines " << lines << " checksum " << checksum << std::endl;
+}
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+
+"""Generates a C++ project the size of a production binary, to test and time SOFI's
+symbol lookups (get_function_from_pc, get_address_at_source_line...) at scale.
+
+Each of the --units compilation units unit_<i>.cpp holds:
+  - a chain of --inline-depth always_inline helpers, inlined into every function
+    (DW_TAG_inlined_subroutine trees, and line table rows jumping back and forth)
+  - a function template instantiated --templates times (subprograms sharing a name)
+  - --functions functions of --lines statements each, one per source line
+  - an entry point calling each of them once
+main.cpp calls every entry point and prints a checksum, so that the binary can be
+injected into like the other examples. The output is deterministic.
+
+With --build, the project is compiled in place with DWARF --dwarf, the binary being
+<out>/synthetic; the CMake target 'synthetic' does the same. libelfin (hence SOFI)
+reads DWARF 2 to 4 only: a DWARF 5 build is for comparing with other tools. GCC's
+location views (DW_AT_GNU_locviews) are turned off, as libelfin doesn't know them.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+
+def write_if_changed(path, text):
+    """Leaves unchanged files alone, so that make rebuilds only what changed."""
+    try:
+        with open(path) as f:
+            if f.read() == text:
+                return
+    except OSError:
+        pass
+    with open(path, "w") as f:
+        f.write(text)
+
+
+def header(args):
+    lines = ["#ifndef SYNTHETIC_HPP", "#define SYNTHETIC_HPP", ""]
+    for u in range(args.units):
+        lines.append("unsigned u%d_entry(unsigned x);" % u)
+    lines += ["", "#endif", ""]
+    return "\n".join(lines)
+
+
+def statement(u, f, s):
+    """The s-th statement of a function body, a few cheap operations on 'v'."""
+    k = (u * 7919 + f * 104729 + s * 31) % 251 + 1
+    return [
+        "    v = v * %du + %du;" % (2 * k + 1, k),
+        "    v ^= v >> %d;" % (s % 13 + 3),
+        "    v += (v << %d) ^ %du;" % (s % 5 + 1, k),
+        "    if (v & %du) v -= %du;" % (1 << (s % 16), k),
+    ][s % 4]
+
+
+def unit(args, u):
+    lines = ['#include "synthetic.hpp"', ""]
+
+    depth = args.inline_depth
+    for d in reversed(range(depth)):
+        lines.append("static inline __attribute__((always_inline)) unsigned u%d_inline_%d(unsigned x) {" % (u, d))
+        lines.append("    x = x * %du + %du;" % (2 * d + 3, u + d))
+        lines.append("    return %s;" % ("u%d_inline_%d(x)" % (u, d + 1) if d + 1 < depth else "x ^ (x >> 7)"))
+        lines.append("}")
+        lines.append("")
+
+    if args.templates:
+        lines.append("template <unsigned N>")
+        lines.append("__attribute__((noinline)) unsigned u%d_template(unsigned x) {" % u)
+        lines.append("    for (unsigned i = 0; i < N % 4 + 1; i++) x = x * 33u + N;")
+        lines.append("    return x;")
+        lines.append("}")
+        lines.append("")
+
+    for f in range(args.functions):
+        lines.append("unsigned u%d_f%d(unsigned x) {" % (u, f))
+        lines.append("    unsigned v = x;")
+        for s in range(args.lines):
+            lines.append(statement(u, f, s))
+        if args.templates:
+            lines.append("    v = u%d_template<%d>(v);" % (u, f % args.templates))
+        lines.append("    return %s;" % ("u%d_inline_0(v)" % u if depth else "v"))
+        lines.append("}")
+        lines.append("")
+
+    lines.append("unsigned u%d_entry(unsigned x) {" % u)
+    for f in range(args.functions):
+        lines.append("    x = u%d_f%d(x);" % (u, f))
+    lines.append("    return x;")
+    lines.append("}")
+    lines.append("")
+    return "\n".join(lines)
+
+
+def main_unit(args):
+    lines = ["#include <cstdio>", '#include "synthetic.hpp"', "", "int main() {", "    unsigned x = 1;"]
+    for u in range(args.units):
+        lines.append("    x = u%d_entry(x);" % u)
+    lines += ['    std::printf("checksum: %u\\n", x);', "    return 0;", "}", ""]
+    return "\n".join(lines)
+
+
+def supported(cxx, flag):
+    probe = subprocess.run([cxx, flag, "-x", "c++", "-c", "-o", os.devnull, "-"], input=b"",
+                           stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return probe.returncode == 0
+
+
+def build(args, sources):
+    flags = ["-gdwarf-%d" % args.dwarf, args.opt]
+    if supported(args.cxx, "-gno-variable-location-views"):
+        flags.append("-gno-variable-location-views")
+    objects = [os.path.splitext(s)[0] + ".o" for s in sources]
+
+    def compile_one(i):
+        if os.path.exists(objects[i]) and os.path.getmtime(objects[i]) >= os.path.getmtime(sources[i]):
+            return 0
+        return subprocess.call([args.cxx, "-std=c++14", "-c"] + flags + ["-o", objects[i], sources[i]])
+
+    with ThreadPoolExecutor(args.jobs) as pool:
+        if any(pool.map(compile_one, range(len(sources)))):
+            return 1
+    return subprocess.call([args.cxx, "-o", os.path.join(args.out, "synthetic")] + objects)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0],
+                                     formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument("--out", required=True, help="directory to generate the project into")
+    parser.add_argument("--units", type=int, default=200, help="compilation units")
+    parser.add_argument("--functions", type=int, default=100, help="functions per compilation unit")
+    parser.add_argument("--inline-depth", type=int, default=3, help="always_inline helpers inlined into each function, nested")
+    parser.add_argument("--templates", type=int, default=8, help="instantiations of each unit's function template")
+    parser.add_argument("--lines", type=int, default=12, help="statements (source lines) per function")
+    parser.add_argument("--build", action="store_true", help="compile the project into <out>/synthetic")
+    parser.add_argument("--dwarf", type=int, choices=[2, 3, 4, 5], default=4, help="DWARF version of the build")
+    parser.add_argument("--opt", default="-O1", help="optimization flag of the build (inlining needs -O1 or more)")
+    parser.add_argument("--cxx", default=os.environ.get("CXX", "c++"), help="compiler of the build")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count() or 1, help="parallel compilations of the build")
+    args = parser.parse_args()
+    if args.units < 1 or args.functions < 1 or args.inline_depth < 0 or args.templates < 0 or args.lines < 0:
+        parser.error("--units and --functions must be positive, the other sizes not negative")
+
+    os.makedirs(args.out, exist_ok=True)
+    write_if_changed(os.path.join(args.out, "synthetic.hpp"), header(args))
+    sources = [os.path.join(args.out, "main.cpp")]
+    write_if_changed(sources[0], main_unit(args))
+    for u in range(args.units):
+        sources.append(os.path.join(args.out, "unit_%d.cpp" % u))
+        write_if_changed(sources[-1], unit(args, u))
+
+    functions = args.units * (args.functions + min(args.functions, args.templates) + 1) + 1
+    print("%s: %d compilation units, %d functions, %d source lines"
+          % (args.out, args.units + 1, functions, sum(1 for s in sources for _ in open(s))))
+    if args.dwarf == 5:
+        print("warning: libelfin reads DWARF 2 to 4, SOFI can't load a DWARF 5 build", file=sys.stderr)
+    if args.build:
+        return build(args, sources)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,97 @@
+#ifndef SOFI_BLOCK_TRACE_HPP
+#define SOFI_BLOCK_TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <unordered_map>
+
+namespace sofi {
+    /*
+    Basic blocks executed by the golden run, with their execution counts and the order they ran in.
+    Addresses are DWARF (unrelocated) addresses. The file layout is:
+        "SOFIBB01"
+        u32 number of blocks, then for each block: u64 address, u64 execution count
+        u64 length of the sequence, then each executed block as a LEB128 index into the block table
+    */
+    class block_trace {
+    public:
+        struct block {
+            uint64_t addr;
+            uint64_t count;
+        };
+
+        void record(uint64_t addr) {
+            auto it = m_index.find(addr);
+            if (it == m_index.end()) {
+                it = m_index.emplace(addr, static_cast<uint32_t>(m_blocks.size())).first;
+                m_blocks.push_back(block{addr, 0});
+            }
+            ++m_blocks[it->second].count;
+            put_uleb128(it->second);
+            ++m_length;
+        }
+
+        bool save(const std::string& path) const {
+            std::ofstream out {path, std::ios::binary};
+            out.write(magic(), magic_size);
+            put(out, static_cast<uint32_t>(m_blocks.size()));
+            for (const auto& b : m_blocks) {
+                put(out, b.addr);
+                put(out, b.count);
+            }
+            put(out, m_length);
+            out.write(reinterpret_cast<const char*>(m_sequence.data()), m_sequence.size());
+            return static_cast<bool>(out);
+        }
+
+        bool load(const std::string& path) { //only the block table, the sequence is left on disk
+            std::ifstream in {path, std::ios::binary};
+            char header[magic_size];
+            if (!in.read(header, magic_size) || std::string(header, magic_size) != magic()) return false;
+
+            uint32_t n_blocks = 0;
+            get(in, n_blocks);
+            *this = block_trace{};
+            for (uint32_t i = 0; i < n_blocks && in; ++i) {
+                block b{};
+                get(in, b.addr);
+                get(in, b.count);
+                m_index.emplace(b.addr, i);
+                m_blocks.push_back(b);
+            }
+            get(in, m_length);
+            return static_cast<bool>(in);
+        }
+
+        auto blocks() const -> const std::vector<block>& { return m_blocks; }
+        auto length() const -> uint64_t { return m_length; }
+        bool empty() const { return m_blocks.empty(); }
+    private:
+        static constexpr std::size_t magic_size = 8;
+        static const char* magic() { return "SOFIBB01"; }
+
+        template <typename T> static void put(std::ofstream& out, T value) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+        template <typename T> static void get(std::ifstream& in, T& value) {
+            in.read(reinterpret_cast<char*>(&value), sizeof(value));
+        }
+
+        void put_uleb128(uint32_t value) {
+            do {
+                uint8_t byte = value & 0x7f;
+                value >>= 7;
+                m_sequence.push_back(value ? (byte | 0x80) : byte);
+            } while (value);
+        }
+
+        std::vector<block> m_blocks;
+        std::unordered_map<uint64_t, uint32_t> m_index; //address to position in m_blocks
+        std::vector<uint8_t> m_sequence;
+        uint64_t m_length = 0;
+    };
+}
+
+#endif
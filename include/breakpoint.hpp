@@ -4,11 +4,14 @@
 #include <cstdint>
 #include <sys/ptrace.h>
 
+#include "tracer_profile.hpp"
+
 namespace sofi {
     class breakpoint {
     public:
         breakpoint() = default;
-        breakpoint(pid_t pid, std::intptr_t addr) : m_pid{pid}, m_addr{addr}, m_enabled{false}, m_saved_data{} {}
+        breakpoint(pid_t pid, std::intptr_t addr, unsigned target_hits = 1)
+            : m_pid{pid}, m_addr{addr}, m_enabled{false}, m_saved_data{}, m_hits{0}, m_target_hits{target_hits} {}
 
         void enable() {
             auto data = ptrace(PTRACE_PEEKDATA, m_pid, m_addr, nullptr);
@@ -30,12 +33,20 @@ namespace sofi {
 
         bool is_enabled() const { return m_enabled; }
 
+        bool hit() { return ++m_hits == m_target_hits; } //counts a hit, true on the target one
+
         auto get_address() const -> std::intptr_t { return m_addr; }
+        auto get_saved_data() const -> uint8_t { return m_saved_data; }
+        auto get_hits() const -> unsigned { return m_hits; }
+        auto get_target_hits() const -> unsigned { return m_target_hits; }
+        void set_target_hits(unsigned target_hits) { m_target_hits = target_hits; }
     private:
-        pid_t m_pid;
-        std::intptr_t m_addr;
-        bool m_enabled;
-        uint8_t m_saved_data; //data which used to be at the breakpoint address
+        pid_t m_pid = 0;
+        std::intptr_t m_addr = 0;
+        bool m_enabled = false;
+        uint8_t m_saved_data = 0; //data which used to be at the breakpoint address
+        unsigned m_hits = 0;
+        unsigned m_target_hits = 1; //the hit on which the fault is injected
     };
 }
 
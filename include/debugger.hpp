@@ -4,14 +4,22 @@
 #include <utility>
 #include <string>
 #include <linux/types.h>
+#include <sys/user.h>
+#include <sys/resource.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <random>
 
 #include "breakpoint.hpp"
+#include "watchpoint.hpp"
+#include "perf_counter.hpp"
+#include "memory_cache.hpp"
+#include "block_trace.hpp"
+#include "tracer_profile.hpp"
 #include "dwarf/dwarf++.hh"
 #include "elf/elf++.hh"
 
-#define INFINITY 10
-
 
 namespace sofi {
     enum class symbol_type {
@@ -32,17 +40,59 @@ namespace sofi {
         }
     }
 
+    enum class run_outcome {
+        running,           // not finished yet
+        exited,            // exit status 0
+        exit_code,         // non zero exit status
+        fatal_signal,      // terminated by a signal
+        timeout,           // killed by the watchdog
+        aborted,           // SOFI gave up on the run and killed the debugee
+        cpu_limit,         // killed by its CPU time limit
+        memory_limit,      // killed by the memory limit of its cgroup
+        pids_limit,        // failed after running out of processes in its cgroup
+        masked,            // stopped early, its state was the same as the golden run's at a checkpoint
+    };
+
+    std::string to_string (run_outcome o) {
+        switch (o) {
+        case run_outcome::running: return "running";
+        case run_outcome::exited: return "exited";
+        case run_outcome::exit_code: return "exit code";
+        case run_outcome::fatal_signal: return "fatal signal";
+        case run_outcome::timeout: return "timeout";
+        case run_outcome::aborted: return "aborted";
+        case run_outcome::cpu_limit: return "cpu limit";
+        case run_outcome::memory_limit: return "memory limit";
+        case run_outcome::pids_limit: return "pids limit";
+        case run_outcome::masked: return "masked";
+        }
+        __builtin_unreachable();
+    }
+
     struct symbol {
         symbol_type type;
         std::string name;
         std::uintptr_t addr;
     };
 
+    using state_items = std::vector<std::pair<uint64_t, uint64_t>>; // (key, hash) pairs sorted by key, see debugger::read_state()
+    using item_contents = std::unordered_map<uint64_t, std::string>; // bytes of the pages and floating point registers read, by hash
+
+    struct state_mask { // what differs between two golden runs, left out of every comparison
+        std::unordered_set<uint64_t> items; // whole items: registers, outputs
+        std::unordered_map<uint64_t, std::vector<uint32_t>> words; // offsets of the 8-byte words zeroed before hashing, by item
+    };
+
+    struct golden_points { // states of a golden run at its observation points
+        std::vector<state_items> states;
+        item_contents contents;
+    };
+
     class debugger {
     public:
         debugger(){};
         debugger (std::string prog_name, pid_t pid)
-             : m_prog_name{std::move(prog_name)}, m_pid{pid} {
+             : m_prog_name{std::move(prog_name)}, m_pid{pid}, m_memory{pid} {
             halt_mode = 0;
             auto fd = open(m_prog_name.c_str(), O_RDONLY);
 
@@ -51,12 +101,15 @@ namespace sofi {
         }
 
         void run();
-        void set_breakpoint_at_address(std::intptr_t addr);
+        void set_breakpoint_at_address(std::intptr_t addr, unsigned target_hits = 1);
+        void remove_breakpoint(std::intptr_t addr);
         void set_breakpoint_at_function(const std::string& name);
         void set_breakpoint_at_source_line(const std::string& file, unsigned line);
+        auto set_watchpoint_at_address(std::intptr_t addr, watch_condition cond, unsigned len) -> unsigned;
+        void remove_watchpoint(unsigned slot);
         void dump_registers();
         void print_backtrace();
-        void read_variables(uint64_t* variables, int&size);
+        auto read_variables(std::vector<uint64_t>* sizes = nullptr) -> std::vector<uint64_t>;
         void print_source(const std::string& file_name, unsigned line, unsigned n_lines_context=2);
         auto lookup_symbol(const std::string& name) -> std::vector<symbol>;
 
@@ -66,20 +119,41 @@ namespace sofi {
         void get_address_at_source_line(const std::string& file, unsigned line, intptr_t& addr);
         void single_step(); 
         void get_function_start_and_end_addresses(const std::string& name, std::intptr_t& start_addr, std::intptr_t& end_addr);
-        void get_alligned_address(std::intptr_t& addr);
+        void get_alligned_address(std::intptr_t& addr, std::intptr_t low, std::intptr_t high);
         void continue_execution_single_step();
-        void mutate_register(std::intptr_t addr);
+        void mutate_register(std::intptr_t addr, unsigned hit = 1);
         void mutate_opcode(std::intptr_t addr);
         dwarf::die get_function_from_name(const std::string& name);
-        void mutate_data(std::intptr_t addr);
+        void mutate_data(std::intptr_t addr, unsigned hit = 1);
+        bool run_to_breakpoint(std::intptr_t addr, unsigned hit);
+        void trace_blocks(block_trace& trace);
+        void trace_statements(block_trace& trace);
+        bool pick_executed_address(const block_trace& trace, std::intptr_t addr1, std::intptr_t addr2, std::intptr_t& addr, unsigned& hit);
+        bool run_to_instruction(uint64_t count);
+        bool run_to_data_access(std::intptr_t addr, std::intptr_t& watch_addr, watch_condition cond, int skip);
+        void corrupt_memory(std::intptr_t addr);
+        void corrupt_register();
+        bool run_to_function_exit(const std::vector<std::intptr_t>& functions);
+        auto read_state(const state_mask& mask, item_contents* contents = nullptr) -> state_items;
+        void fix_random_bytes();
+        void clear_dirty_pages();
+        void run_to_exit();
+        void kill_and_reap();
+        void enter(phase p);
+        void seed(uint64_t campaign_seed, long tid);
+        auto random() -> int;
 
         void handle_command(const std::string& line);
-        void continue_execution();
+        void continue_execution(int sig = 0);
+        auto pending_signal() -> int;
         auto get_pc() -> uint64_t;
         auto get_offset_pc() -> uint64_t;
         void set_pc(uint64_t pc);
+        auto get_registers() -> user_regs_struct&;
+        void set_registers();
         void step_over_breakpoint();
         siginfo_t wait_for_signal();
+        bool wait_for_status();
         auto get_signal_info() -> siginfo_t;
 
         void handle_sigtrap(siginfo_t info);
@@ -92,21 +166,46 @@ namespace sofi {
         auto get_line_entry_from_pc(uint64_t pc) -> dwarf::line_table::iterator;
 
         auto read_memory(uint64_t address) -> uint64_t ;
+        bool read_memory(uint64_t address, void* buffer, std::size_t size);
         void write_memory(uint64_t address, uint64_t value);
 
         std::string m_prog_name;
         pid_t m_pid;
         uint64_t m_load_address = 0;
         std::unordered_map<std::intptr_t,breakpoint> m_breakpoints;
+        std::unordered_map<unsigned,watchpoint> m_watchpoints; // keyed by debug register slot
+        std::vector<std::pair<uint64_t, uint64_t>> m_returns; // return address and stack pointer of the checkpoint calls in progress
+        int m_wait_status = 0;
+        user_regs_struct m_regs; // registers of the current stop, only valid while m_regs_valid
+        bool m_regs_valid = false;
+        memory_cache m_memory; // pages read during the current stop
         dwarf::dwarf m_dwarf;
         elf::elf m_elf;
         siginfo_t result;
-        int duration = 0;
+        uint64_t duration = 0; // wall clock time of the run, in microseconds
         int halt_mode;
-        int ttl = INFINITY;
         std::string originalOut="";
         std::string originalErr="";
         int sdc = 0;
+        run_outcome outcome = run_outcome::running;
+        int exit_code = 0; // exit status of a debugee that exited
+        long long divergence_out = -1; // offset of the first byte that differs from the golden output, -1 if none
+        long long divergence_err = -1;
+        std::string divergence_file = ""; // first output file that differs from the golden run's
+        uint64_t instructions = 0; // user mode instructions retired by the golden run (CPU nanoseconds without a PMU)
+        uint64_t cpu_time = 0; // user and system CPU time of the debugee, in microseconds, known once it's reaped
+        uint64_t user_time = 0; // the rest of its resource usage, also known once it's reaped
+        uint64_t system_time = 0;
+        uint64_t max_rss = 0; // kilobytes
+        uint64_t minor_faults = 0;
+        uint64_t major_faults = 0;
+        uint64_t counted_instructions = 0; // over the whole run, with perf counters (task clock nanoseconds without a PMU)
+        uint64_t counted_cycles = 0;
+        int perf_fault = 0; // used many times more of a resource than the golden run
+        double perf_ratio = 0; // highest ratio of a resource to the golden run's p99
+        std::string perf_resource = "";
+        phase_clock* clock = nullptr; // phases of the run, if it's profiled
+        std::mt19937 m_rng; // the run's own, so that runs don't depend on each other's draws
     };
 }
 
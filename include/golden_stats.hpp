@@ -0,0 +1,96 @@
+#ifndef SOFI_GOLDEN_STATS_HPP
+#define SOFI_GOLDEN_STATS_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <sys/stat.h>
+
+namespace sofi {
+    /*
+    Resources used by the golden run (wall clock duration and CPU times in microseconds, max RSS in kilobytes, counters...),
+    over one or more runs made in parallel, so that they are measured under a load like the faulty runs'.
+    Timeouts and performance faults are derived from their p99. The golden cache keeps them in a small text file,
+    valid until the program is rebuilt:
+        SOFIGS02
+        program <size> <modification time in nanoseconds>
+        runs <number of runs>
+        <metric> <p50> <p99>, one line per metric
+    */
+    class golden_stats {
+    public:
+        void add(const std::string& metric, uint64_t value) { m_samples[metric].push_back(value); }
+
+        void summarize() {
+            m_runs = 0;
+            for (const auto& s : m_samples) {
+                m_summary[s.first] = {percentile(s.second, 50), percentile(s.second, 99)};
+                m_runs = std::max<uint64_t>(m_runs, s.second.size());
+            }
+        }
+
+        bool save(const std::string& path, const std::string& prog) const {
+            std::ofstream out {path};
+            out << magic() << "\n"
+                << "program " << identity(prog) << "\n"
+                << "runs " << m_runs << "\n";
+            for (const auto& s : m_summary) {
+                out << s.first << " " << s.second.first << " " << s.second.second << "\n";
+            }
+            return static_cast<bool>(out);
+        }
+
+        bool load(const std::string& path, const std::string& prog) { //false if there is no cache, or if it's stale
+            std::ifstream in {path};
+            std::string header, key;
+            uint64_t size = 0, mtime = 0;
+            if (!(in >> header) || header != magic()) return false;
+            if (!(in >> key >> size >> mtime) || key != "program") return false;
+            if (std::to_string(size) + " " + std::to_string(mtime) != identity(prog)) return false;
+
+            golden_stats stats;
+            if (!(in >> key >> stats.m_runs) || key != "runs" || stats.m_runs == 0) return false;
+            uint64_t p50, p99;
+            while (in >> key >> p50 >> p99) {
+                stats.m_summary[key] = {p50, p99};
+            }
+            *this = stats;
+            return true;
+        }
+
+        auto runs() const -> uint64_t { return m_runs; }
+        auto p50(const std::string& metric) const -> uint64_t { //0 if it wasn't measured
+            auto it = m_summary.find(metric);
+            return it == m_summary.end() ? 0 : it->second.first;
+        }
+        auto p99(const std::string& metric) const -> uint64_t {
+            auto it = m_summary.find(metric);
+            return it == m_summary.end() ? 0 : it->second.second;
+        }
+    private:
+        static const char* magic() { return "SOFIGS02"; }
+
+        static std::string identity(const std::string& prog) { //rebuilding the program invalidates the cache
+            struct stat st {};
+            stat(prog.c_str(), &st);
+            uint64_t mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec;
+            return std::to_string(st.st_size) + " " + std::to_string(mtime);
+        }
+
+        static uint64_t percentile(std::vector<uint64_t> samples, unsigned p) { //nearest rank
+            if (samples.empty()) return 0;
+            std::sort(samples.begin(), samples.end());
+            auto rank = (samples.size() * p + 99) / 100;
+            return samples[std::max<std::size_t>(rank, 1) - 1];
+        }
+
+        std::map<std::string, std::vector<uint64_t>> m_samples;
+        std::map<std::string, std::pair<uint64_t, uint64_t>> m_summary; //p50 and p99
+        uint64_t m_runs = 0;
+    };
+}
+
+#endif
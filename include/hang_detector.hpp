@@ -0,0 +1,89 @@
+#ifndef SOFI_HANG_DETECTOR_HPP
+#define SOFI_HANG_DETECTOR_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "perf_counter.hpp"
+
+namespace sofi {
+    /*
+    Tells when a debugee hangs from what it consumes, not from wall clock time, so that runs slowed down by a loaded machine
+    aren't taken for hangs. A debugee hangs once it has used up its budget of CPU time (in microseconds) or of instructions,
+    or when it has made no progress at all for 'stall', e.g. because it's blocked on a read that never returns.
+    Time the debugee spends stopped by its tracer (injecting, counting hits) is never a stall.
+    */
+    class hang_detector {
+    public:
+        hang_detector() = default;
+        hang_detector(const hang_detector&) = delete;
+        hang_detector& operator=(const hang_detector&) = delete;
+        ~hang_detector() {
+            if (m_stat >= 0) close(m_stat);
+        }
+
+        bool attach(pid_t pid, uint64_t budget, std::chrono::microseconds stall, bool count_instructions) {
+            m_budget = budget;
+            m_stall = stall;
+            m_last = 0;
+            m_last_progress = std::chrono::steady_clock::now();
+            m_stat = open(("/proc/" + std::to_string(pid) + "/stat").c_str(), O_RDONLY | O_CLOEXEC);
+            if (count_instructions && m_counter.open(pid)) {
+                m_counter.enable();
+            }
+            m_attached = m_counter.is_open() || clock_getcpuclockid(pid, &m_clock) == 0;
+            return m_attached;
+        }
+
+        bool hung() { //samples the debugee, a budget of 0 means no budget
+            uint64_t used = 0;
+            if (!sample(used)) return false; //gone already
+            auto now = std::chrono::steady_clock::now();
+            if (used != m_last || traced_stop()) {
+                m_last = used;
+                m_last_progress = now;
+            }
+            return (m_budget && used > m_budget) || now - m_last_progress > m_stall;
+        }
+
+        bool is_attached() const { return m_attached; }
+        auto used() const -> uint64_t { return m_last; }
+    private:
+        bool traced_stop() { //the state field of /proc/pid/stat follows the command name, which may hold spaces
+            char buffer[256];
+            auto n = m_stat >= 0 ? pread(m_stat, buffer, sizeof(buffer) - 1, 0) : -1;
+            if (n <= 0) return false;
+            buffer[n] = 0;
+            std::string stat {buffer};
+            auto paren = stat.rfind(')');
+            return paren != std::string::npos && paren + 2 < stat.size() && stat[paren + 2] == 't';
+        }
+
+        bool sample(uint64_t& used) {
+            if (m_counter.is_open()) {
+                used = m_counter.read();
+                return true;
+            }
+            timespec ts;
+            if (clock_gettime(m_clock, &ts) != 0) return false;
+            used = static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+            return true;
+        }
+
+        bool m_attached = false;
+        clockid_t m_clock {};
+        perf_counter m_counter; //instructions (or task clock nanoseconds), instead of the CPU clock
+        uint64_t m_budget = 0;
+        uint64_t m_last = 0;
+        std::chrono::microseconds m_stall {0};
+        int m_stat = -1; //kept open, read once per sample
+        std::chrono::steady_clock::time_point m_last_progress;
+    };
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef SOFI_MEMORY_CACHE_HPP
+#define SOFI_MEMORY_CACHE_HPP
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <sys/uio.h>
+#include <sys/ptrace.h>
+
+#include "tracer_profile.hpp"
+
+namespace sofi {
+    /*
+    Keeps a few pages of the debugee's memory, read with one process_vm_readv each (or PTRACE_PEEKDATA when
+    that is not permitted). It's only valid while the debugee stays stopped: invalidate it on every resume and write.
+    */
+    class memory_cache {
+    public:
+        static constexpr std::size_t page_size = 4096;
+        static constexpr std::size_t n_pages = 4;
+
+        memory_cache() = default;
+        explicit memory_cache(pid_t pid) : m_pid{pid} {}
+
+        bool read(uint64_t addr, void* buf, std::size_t len) {
+            auto out = static_cast<uint8_t*>(buf);
+            while (len > 0) {
+                auto base = addr & ~static_cast<uint64_t>(page_size - 1);
+                auto p = get_page(base);
+                if (!p) return false;
+
+                auto offset = addr - base;
+                auto n = std::min(len, static_cast<std::size_t>(page_size - offset));
+                std::memcpy(out, p->data.data() + offset, n);
+                addr += n;
+                out += n;
+                len -= n;
+            }
+            return true;
+        }
+
+        void invalidate() {
+            for (auto& p : m_pages) p.valid = false;
+        }
+    private:
+        struct page {
+            uint64_t base = 0;
+            bool valid = false;
+            std::vector<uint8_t> data; //allocated on first use, so unused caches are cheap to copy
+        };
+
+        page* get_page(uint64_t base) {
+            for (auto& p : m_pages) {
+                if (p.valid && p.base == base) return &p;
+            }
+
+            auto& p = m_pages[m_next];
+            m_next = (m_next + 1) % n_pages;
+            p.data.resize(page_size);
+            p.base = base;
+            p.valid = fill(p);
+            return p.valid ? &p : nullptr;
+        }
+
+        bool fill(page& p) {
+            iovec local {p.data.data(), page_size};
+            iovec remote {reinterpret_cast<void*>(p.base), page_size};
+            if (process_vm_readv(m_pid, &local, 1, &remote, 1, 0) == static_cast<ssize_t>(page_size)) {
+                count_transfer(page_size, 0);
+                return true;
+            }
+
+            for (std::size_t i = 0; i < page_size; i += sizeof(long)) {
+                errno = 0;
+                auto word = ptrace(PTRACE_PEEKDATA, m_pid, p.base + i, nullptr);
+                if (errno) return false;
+                std::memcpy(p.data.data() + i, &word, sizeof(word));
+            }
+            return true;
+        }
+
+        pid_t m_pid = 0;
+        std::array<page, n_pages> m_pages;
+        std::size_t m_next = 0; //round robin replacement
+    };
+}
+
+#endif
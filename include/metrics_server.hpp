@@ -0,0 +1,111 @@
+#ifndef SOFI_METRICS_SERVER_HPP
+#define SOFI_METRICS_SERVER_HPP
+
+#include <string>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+namespace sofi {
+    /*
+    Serves the Prometheus text format over HTTP on a Unix socket, e.g. for curl --unix-socket PATH http://localhost/metrics.
+    Scrapes are answered from a thread of its own by 'render', which must only read counters the workers update with atomics:
+    scraping never waits on a run, and a run never waits on a scrape.
+    */
+    class metrics_server {
+    public:
+        metrics_server() = default;
+        metrics_server(const metrics_server&) = delete;
+        metrics_server& operator=(const metrics_server&) = delete;
+        ~metrics_server() { stop(); }
+
+        bool start(const std::string& path, std::function<std::string()> render) {
+            sockaddr_un addr {};
+            if (path.size() >= sizeof(addr.sun_path)) return false;
+            addr.sun_family = AF_UNIX;
+            std::strcpy(addr.sun_path, path.c_str());
+            unlink(path.c_str()); // left behind by an earlier campaign
+            m_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+            if (m_listen < 0 || bind(m_listen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || listen(m_listen, 16) == -1) {
+                if (m_listen >= 0) close(m_listen);
+                m_listen = -1;
+                return false;
+            }
+            m_path = path;
+            m_render = std::move(render);
+            m_epoll = epoll_create1(EPOLL_CLOEXEC);
+            m_wakeup = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            for (int fd : {m_listen, m_wakeup}) {
+                epoll_event ev {};
+                ev.events = EPOLLIN;
+                ev.data.fd = fd;
+                epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+            }
+            m_thread = std::thread{[this] { serve(); }};
+            return true;
+        }
+
+        void stop() {
+            if (m_listen < 0) return;
+            uint64_t one = 1;
+            if (write(m_wakeup, &one, sizeof(one)) < 0) {}
+            m_thread.join();
+            close(m_listen);
+            close(m_wakeup);
+            close(m_epoll);
+            unlink(m_path.c_str());
+            m_listen = -1;
+        }
+    private:
+        void serve() {
+            while (true) {
+                epoll_event ev;
+                int n = epoll_wait(m_epoll, &ev, 1, -1);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0 || ev.data.fd == m_wakeup) return;
+                int client = accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client < 0) continue;
+                respond(client);
+                close(client);
+            }
+        }
+
+        void respond(int client) { //one request per connection, whatever it asks for
+            timeval timeout {1, 0}; // a client that never sends its request doesn't hold up the next ones for long
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            std::string request;
+            char buffer[1024];
+            while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos && request.size() < 8192) {
+                auto n = read(client, buffer, sizeof(buffer));
+                if (n <= 0) break;
+                request.append(buffer, n);
+            }
+            auto body = m_render();
+            auto response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size())
+                            + "\r\nConnection: close\r\n\r\n" + body;
+            for (std::size_t sent = 0; sent < response.size(); ) {
+                auto n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                sent += n;
+            }
+        }
+
+        std::string m_path;
+        std::function<std::string()> m_render;
+        int m_listen = -1;
+        int m_epoll = -1;
+        int m_wakeup = -1;
+        std::thread m_thread;
+    };
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SOFI_MPSC_QUEUE_HPP
+#define SOFI_MPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+namespace sofi {
+    /*
+    Bounded lock-free queue with any number of producers and a single consumer. Every slot carries a sequence number:
+    a producer claims the next slot with one compare-and-swap on the tail and publishes its value by bumping the slot's sequence,
+    the consumer frees it by bumping it again by 'Capacity'. Neither side ever waits on the other, except when the queue is full.
+    */
+    template <typename T, std::size_t Capacity>
+    class mpsc_queue {
+    public:
+        mpsc_queue() {
+            for (std::size_t i = 0; i < Capacity; ++i) {
+                m_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        mpsc_queue(const mpsc_queue&) = delete;
+        mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+        bool try_push(const T& value) { //false if the queue is full
+            auto pos = m_tail.load(std::memory_order_relaxed);
+            while (true) {
+                auto& s = m_slots[pos % Capacity];
+                auto seq = s.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+                if (diff == 0) {
+                    if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        s.value = value;
+                        s.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = m_tail.load(std::memory_order_relaxed); // another producer took it
+                }
+            }
+        }
+
+        void push(const T& value) { //waits for the consumer to make room
+            while (!try_push(value)) std::this_thread::yield();
+        }
+
+        bool try_pop(T& value) { //consumer only
+            auto head = m_head.load(std::memory_order_relaxed);
+            auto& s = m_slots[head % Capacity];
+            if (s.sequence.load(std::memory_order_acquire) != head + 1) return false;
+            value = s.value;
+            s.sequence.store(head + Capacity, std::memory_order_release);
+            m_head.store(head + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        auto size() const -> std::size_t { //values claimed and not popped yet, a snapshot that may already be stale
+            auto head = m_head.load(std::memory_order_relaxed);
+            auto tail = m_tail.load(std::memory_order_relaxed);
+            return tail > head ? tail - head : 0;
+        }
+    private:
+        struct slot {
+            std::atomic<uint64_t> sequence;
+            T value;
+        };
+
+        std::array<slot, Capacity> m_slots;
+        alignas(64) std::atomic<uint64_t> m_tail {0}; //next slot to claim, shared by the producers
+        alignas(64) std::atomic<uint64_t> m_head {0}; //next slot to read, only the consumer writes it
+    };
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef SOFI_OUTPUT_CAPTURE_HPP
+#define SOFI_OUTPUT_CAPTURE_HPP
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <unordered_map>
+#include <csignal>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+#include "output_compare.hpp"
+
+namespace sofi {
+    /*
+    Drains the stdout and stderr pipes of every debugee from a single epoll thread for as long as they run,
+    so that a chatty debugee never blocks on a full pipe and none of its output is lost.
+    Streams with a golden output are compared as they arrive instead of being kept.
+    */
+    class output_capture {
+    public:
+        struct stream {
+            uint64_t id;
+            int fd;
+            std::string data; //grows with the output
+            bool closed = false; //end of file was seen, or the stream was abandoned
+            bool compared = false;
+            stream_comparator comparator;
+            int pidfd = -1; //of the debugee killed as soon as the output diverges, if set. Unlike its pid, never another process once it's reaped
+        };
+        using handle = std::shared_ptr<stream>;
+
+        output_capture() {
+            m_epoll = epoll_create1(EPOLL_CLOEXEC);
+            m_wakeup = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            epoll_event ev {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = 0;
+            epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+            m_thread = std::thread{[this] { drain(); }};
+        }
+
+        ~output_capture() {
+            uint64_t one = 1;
+            if (write(m_wakeup, &one, sizeof(one)) < 0) {}
+            m_thread.join();
+            close(m_wakeup);
+            close(m_epoll);
+        }
+
+        handle add(int fd, const golden_output* golden = nullptr, pid_t kill_on_divergence = 0) { //fd must be the non-blocking read end of a pipe
+            std::lock_guard<std::mutex> lck(m_mutex);
+            auto s = std::make_shared<stream>();
+            s->id = ++m_next_id;
+            s->fd = fd;
+            if (golden) {
+                s->compared = true;
+                s->comparator = stream_comparator{golden};
+                if (kill_on_divergence) s->pidfd = syscall(SYS_pidfd_open, kill_on_divergence, 0); //close-on-exec. Not killed early before Linux 5.3
+            }
+            m_streams[s->id] = s;
+
+            epoll_event ev {};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.u64 = s->id;
+            epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+            return s;
+        }
+
+        std::string finish(const handle& s, std::chrono::milliseconds grace = std::chrono::seconds(1)) {
+        /*
+        Waits for the end of the stream and returns everything that was written to it (nothing for compared streams). Once the
+        debugee is gone, end of file follows immediately, unless a process it forked still holds the pipe: then we give up after 'grace'.
+        */
+            std::unique_lock<std::mutex> lck(m_mutex);
+            m_closed.wait_for(lck, grace, [&] { return s->closed; });
+            remove(*s);
+            if (s->compared) s->comparator.end();
+            return std::move(s->data);
+        }
+
+        void discard(const handle& s) {
+            std::lock_guard<std::mutex> lck(m_mutex);
+            remove(*s);
+        }
+
+        std::pair<uint64_t, uint64_t> snapshot(const handle& s) { //size and hash of everything written so far, while the debugee is stopped
+            std::lock_guard<std::mutex> lck(m_mutex);
+            if (!s->closed) read_available(*s); //what is still in the pipe
+            if (s->compared) return {s->comparator.size(), s->comparator.hash()};
+            return {s->data.size(), fnv1a(s->data.data(), s->data.size())};
+        }
+    private:
+        void remove(stream& s) { //requires m_mutex
+            if (m_streams.erase(s.id)) {
+                epoll_ctl(m_epoll, EPOLL_CTL_DEL, s.fd, nullptr);
+            }
+            if (s.pidfd >= 0) {
+                close(s.pidfd);
+                s.pidfd = -1;
+            }
+            s.closed = true;
+        }
+
+        void drain() {
+            epoll_event events[64];
+            while (true) {
+                int n = epoll_wait(m_epoll, events, 64, -1);
+                std::lock_guard<std::mutex> lck(m_mutex);
+                for (int i = 0; i < n; ++i) {
+                    if (events[i].data.u64 == 0) return;
+
+                    auto it = m_streams.find(events[i].data.u64);
+                    if (it == m_streams.end()) continue; //removed after epoll_wait returned
+                    read_available(*it->second);
+                }
+            }
+        }
+
+        void read_available(stream& s) { //requires m_mutex
+            char buffer[65536];
+            ssize_t count;
+            while ((count = read(s.fd, buffer, sizeof(buffer))) > 0) {
+                if (!s.compared) {
+                    s.data.append(buffer, count);
+                    continue;
+                }
+                s.comparator.feed(buffer, count);
+                if (s.pidfd >= 0 && s.comparator.diverged()) { //the run is a silent data corruption whatever happens next
+                    syscall(SYS_pidfd_send_signal, s.pidfd, SIGKILL, nullptr, 0); //ESRCH if the worker already reaped it
+                    close(s.pidfd);
+                    s.pidfd = -1;
+                }
+            }
+            if (count == 0) { //every write end is closed
+                remove(s);
+                m_closed.notify_all();
+            }
+        }
+
+        int m_epoll;
+        int m_wakeup;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_closed;
+        std::unordered_map<uint64_t, handle> m_streams;
+        uint64_t m_next_id = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SOFI_OUTPUT_COMPARE_HPP
+#define SOFI_OUTPUT_COMPARE_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <sys/mman.h>
+
+namespace sofi {
+    inline uint64_t fnv1a(const char* data, std::size_t size, uint64_t hash = 0xcbf29ce484222325ull) { //streaming 64 bit FNV-1a
+        for (std::size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    class golden_output { //one output stream of the golden run, kept once in a read-only mapping shared by all threads
+    public:
+        golden_output() = default;
+        golden_output(const golden_output&) = delete;
+        golden_output& operator=(const golden_output&) = delete;
+        ~golden_output() { reset(); }
+
+        void assign(const std::string& data) {
+            reset();
+            m_size = data.size();
+            m_hash = fnv1a(data.data(), data.size());
+            if (m_size == 0) return;
+
+            void* map = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (map == MAP_FAILED) {
+                m_size = 0;
+                return;
+            }
+            std::memcpy(map, data.data(), m_size);
+            mprotect(map, m_size, PROT_READ);
+            m_data = static_cast<const char*>(map);
+        }
+
+        void adopt(const char* map, std::size_t size) { //takes ownership of a read-only mapping, e.g. of the golden run's memfd
+            reset();
+            m_data = map;
+            m_size = size;
+            m_hash = fnv1a(map, size);
+        }
+
+        auto data() const -> const char* { return m_data; }
+        auto size() const -> std::size_t { return m_size; }
+        auto hash() const -> uint64_t { return m_hash; }
+    private:
+        void reset() {
+            if (m_data) munmap(const_cast<char*>(m_data), m_size);
+            m_data = nullptr;
+            m_size = 0;
+        }
+
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+        uint64_t m_hash = fnv1a(nullptr, 0);
+    };
+
+    class stream_comparator { //compares an output stream with the golden one as it arrives, without keeping it
+    public:
+        stream_comparator() = default;
+        explicit stream_comparator(const golden_output* golden) : m_golden{golden} {}
+
+        void feed(const char* data, std::size_t size) {
+            if (m_divergence < 0) {
+                auto available = m_offset < m_golden->size() ? m_golden->size() - m_offset : 0;
+                auto n = std::min(size, available);
+                auto golden = m_golden->data() + m_offset;
+                if (std::memcmp(data, golden, n) != 0) { //vectorised by the C library, the byte loop only runs once
+                    m_divergence = m_offset + (std::mismatch(data, data + n, golden).first - data);
+                }
+                else if (size > available) { //longer than the golden output
+                    m_divergence = m_offset + available;
+                }
+            }
+            m_offset += size;
+        }
+
+        void end() { //shorter than the golden output
+            if (m_divergence < 0 && m_offset < m_golden->size()) {
+                m_divergence = m_offset;
+            }
+        }
+
+        bool diverged() const { return m_divergence >= 0; }
+        auto divergence() const -> long long { return m_divergence; } //offset of the first wrong byte, -1 if none
+        auto size() const -> uint64_t { return m_offset; }
+        auto hash() -> uint64_t { //of everything fed so far, only computed when asked for
+            if (m_divergence >= 0) return ~0ull; //what was fed isn't kept, but it's no prefix of the golden output
+            m_hash = fnv1a(m_golden->data() + m_hashed, m_offset - m_hashed, m_hash); //the same bytes up to here
+            m_hashed = m_offset;
+            return m_hash;
+        }
+    private:
+        const golden_output* m_golden = nullptr;
+        uint64_t m_offset = 0;
+        long long m_divergence = -1;
+        uint64_t m_hashed = 0; //bytes m_hash covers
+        uint64_t m_hash = fnv1a(nullptr, 0);
+    };
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef SOFI_PERF_COUNTER_HPP
+#define SOFI_PERF_COUNTER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace sofi {
+    /*
+    Counts the user mode instructions retired by a debugee (or another hardware event, e.g. cycles). When the PMU is not available (e.g. inside most VMs),
+    it falls back to the task clock, so counts are then in nanoseconds of CPU time instead of instructions.
+    Either way, a counter opened the same way in the golden and in the faulty runs measures the same thing.
+    */
+    class perf_counter {
+    public:
+        perf_counter() = default;
+        perf_counter(const perf_counter&) = delete;
+        perf_counter& operator=(const perf_counter&) = delete;
+        ~perf_counter() { close(); }
+
+        bool open(pid_t pid, uint64_t sample_period = 0, uint64_t event = PERF_COUNT_HW_INSTRUCTIONS) { //opened disabled, call enable() or arm_overflow() before running
+            m_software = false;
+            m_fd = open_event(pid, PERF_TYPE_HARDWARE, event, sample_period);
+            if (m_fd < 0) {
+                m_software = true;
+                m_fd = open_event(pid, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, sample_period);
+            }
+            return m_fd >= 0;
+        }
+
+        void close() {
+            if (m_fd >= 0) ::close(m_fd);
+            m_fd = -1;
+        }
+
+        void enable() { ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0); }
+        void disable() { ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0); }
+
+        bool arm_overflow(pid_t pid, int signo) { //the debugee gets 'signo' once the sample period has elapsed, then the counter stops
+            f_owner_ex owner {F_OWNER_TID, pid};
+            if (fcntl(m_fd, F_SETOWN_EX, &owner) == -1 ||
+                fcntl(m_fd, F_SETSIG, signo) == -1 ||
+                fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_ASYNC) == -1) {
+                return false;
+            }
+            return ioctl(m_fd, PERF_EVENT_IOC_REFRESH, 1) == 0;
+        }
+
+        uint64_t read() const {
+            uint64_t count = 0;
+            if (::read(m_fd, &count, sizeof(count)) != sizeof(count)) return 0;
+            return count;
+        }
+
+        bool is_open() const { return m_fd >= 0; }
+        bool is_software() const { return m_software; }
+        int get_fd() const { return m_fd; }
+    private:
+        static int open_event(pid_t pid, uint32_t type, uint64_t config, uint64_t sample_period) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.sample_period = sample_period;
+            attr.wakeup_events = 1;
+            return syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+
+        int m_fd = -1;
+        bool m_software = false;
+    };
+}
+
+#endif
@@ -2,7 +2,11 @@
 #define SOFI_REGISTERS_HPP
 
 #include <sys/user.h>
+#include <cstddef>
 #include <algorithm>
+#include <array>
+
+#include "tracer_profile.hpp"
 
 namespace sofi {
     enum class reg {
@@ -55,13 +59,18 @@ namespace sofi {
             { reg::gs, 55, "gs" },
     }};
 
-    uint64_t get_register_value(pid_t pid, reg r) {
-        user_regs_struct regs;
-        ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+    uint64_t get_register_value(const user_regs_struct& regs, reg r) {
+        auto it = std::find_if(begin(g_register_descriptors), end(g_register_descriptors),
+                               [r](auto&& rd) { return rd.r == r; });
+
+        return *(reinterpret_cast<const uint64_t*>(&regs) + (it - begin(g_register_descriptors)));
+    }
+
+    uint64_t get_register_value(pid_t pid, reg r) { //one register costs half as much with PTRACE_PEEKUSER as the whole set
         auto it = std::find_if(begin(g_register_descriptors), end(g_register_descriptors),
                                [r](auto&& rd) { return rd.r == r; });
 
-        return *(reinterpret_cast<uint64_t*>(&regs) + (it - begin(g_register_descriptors)));
+        return ptrace(PTRACE_PEEKUSER, pid, offsetof(user, regs) + (it - begin(g_register_descriptors)) * sizeof(uint64_t), nullptr);
     }
 
     void set_register_value(pid_t pid, reg r, uint64_t value) {
@@ -74,14 +83,20 @@ namespace sofi {
         ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
     }
 
-    uint64_t get_register_value_from_dwarf_register (pid_t pid, unsigned regnum) {
+    uint64_t get_register_value_from_dwarf_register (const user_regs_struct& regs, unsigned regnum) {
         auto it = std::find_if(begin(g_register_descriptors), end(g_register_descriptors),
                                [regnum](auto&& rd) { return rd.dwarf_r == regnum; });
         if (it == end(g_register_descriptors)) {
             throw std::out_of_range{"Unknown dwarf register"};
         }
 
-        return get_register_value(pid, it->r);
+        return *(reinterpret_cast<const uint64_t*>(&regs) + (it - begin(g_register_descriptors)));
+    }
+
+    uint64_t get_register_value_from_dwarf_register (pid_t pid, unsigned regnum) {
+        user_regs_struct regs;
+        ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+        return get_register_value_from_dwarf_register(regs, regnum);
     }
 
     std::string get_register_name(reg r) {
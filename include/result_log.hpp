@@ -0,0 +1,148 @@
+#ifndef SOFI_RESULT_LOG_HPP
+#define SOFI_RESULT_LOG_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace sofi {
+    struct result_record { //one run, as it's logged: fixed size, without pointers
+        uint64_t tid = 0;
+        uint64_t site = 0; // DWARF address where the fault was injected, 0 if it wasn't
+        uint32_t hit = 0; // execution of the site that triggered it
+        char fault[12] = {}; // injection type
+        uint8_t outcome = 0; // run_outcome
+        uint8_t halt = 0;
+        uint8_t sdc = 0;
+        uint8_t perf_fault = 0;
+        int32_t exit_code = 0;
+        int32_t signo = 0; // siginfo of the signal that ended the run
+        int32_t si_code = 0;
+        int32_t si_errno = 0;
+        int32_t divergence_file = -1; // index of the first output file that differs, -1 if none
+        uint64_t duration = 0; // microseconds
+        uint64_t cpu_time = 0;
+        uint64_t user_time = 0;
+        uint64_t system_time = 0;
+        uint64_t max_rss = 0; // kilobytes
+        uint64_t minor_faults = 0;
+        uint64_t major_faults = 0;
+        uint64_t counted_instructions = 0;
+        uint64_t counted_cycles = 0;
+        uint64_t instructions = 0; // measured by the golden run for the instruction count trigger
+        int64_t divergence_out = -1;
+        int64_t divergence_err = -1;
+        float perf_ratio = 0;
+        char perf_resource[12] = {};
+        uint64_t padding[3] = {};
+    };
+    static_assert(sizeof(result_record) == 192, "records are laid out back to back in the log");
+
+    /*
+    Append-only log of result records, written through a sliding window of the file mapped in memory, so that memory use doesn't
+    grow with the campaign. The header counts complete records only: after a crash, the log still holds every run logged before it.
+        "SOFIRL01", u32 record size, u32 reserved, u64 number of records, padding up to the first record at 'header_size'
+    */
+    class result_log {
+    public:
+        static constexpr uint64_t header_size = sizeof(result_record);
+        static constexpr uint64_t window_size = sizeof(result_record) << 12; // page aligned, and never splits a record
+
+        result_log() = default;
+        result_log(const result_log&) = delete;
+        result_log& operator=(const result_log&) = delete;
+        ~result_log() { close(); }
+
+        bool open(const std::string& path) {
+            m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (m_fd < 0 || !map_window(0)) {
+                close();
+                return false;
+            }
+            std::memcpy(m_window, magic(), 8);
+            uint32_t size = sizeof(result_record);
+            std::memcpy(m_window + 8, &size, sizeof(size));
+            m_count = 0;
+            publish();
+            return true;
+        }
+
+        bool append(const result_record& r) {
+            auto offset = header_size + m_count * sizeof(result_record);
+            if (offset - m_window_offset >= window_size && !map_window(offset - offset % window_size)) return false;
+            std::memcpy(m_window + (offset - m_window_offset), &r, sizeof(r));
+            ++m_count;
+            if (m_window_offset == 0) publish(); // the header is in the window
+            else {
+                uint64_t count = m_count;
+                pwrite(m_fd, &count, sizeof(count), 16);
+            }
+            return true;
+        }
+
+        void close() { //trims the file to its records
+            if (m_window) munmap(m_window, window_size);
+            if (m_fd >= 0) {
+                ftruncate(m_fd, header_size + m_count * sizeof(result_record));
+                ::close(m_fd);
+            }
+            m_window = nullptr;
+            m_fd = -1;
+        }
+
+        bool is_open() const { return m_fd >= 0; }
+        auto count() const -> uint64_t { return m_count; }
+
+        static bool read(const std::string& path, const std::function<void(const result_record&)>& f) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return false;
+            struct stat st;
+            char header[header_size];
+            uint32_t size = 0;
+            uint64_t count = 0;
+            bool valid = fstat(fd, &st) == 0 && pread(fd, header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+                         && std::memcmp(header, magic(), 8) == 0;
+            if (valid) {
+                std::memcpy(&size, header + 8, sizeof(size));
+                std::memcpy(&count, header + 16, sizeof(count));
+                valid = size == sizeof(result_record) && header_size + count * size <= static_cast<uint64_t>(st.st_size);
+            }
+            for (uint64_t i = 0; valid && i < count; ++i) {
+                result_record r;
+                if (pread(fd, &r, sizeof(r), header_size + i * sizeof(r)) != static_cast<ssize_t>(sizeof(r))) break;
+                f(r);
+            }
+            ::close(fd);
+            return valid;
+        }
+    private:
+        static const char* magic() { return "SOFIRL01"; }
+
+        bool map_window(uint64_t offset) { //the file grows one window at a time
+            if (m_window) munmap(m_window, window_size);
+            m_window = nullptr;
+            if (ftruncate(m_fd, offset + window_size) == -1) return false;
+            void* map = mmap(nullptr, window_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, offset);
+            if (map == MAP_FAILED) return false;
+            m_window = static_cast<char*>(map);
+            m_window_offset = offset;
+            return true;
+        }
+
+        void publish() { //the record is complete before it's counted
+            __atomic_store_n(reinterpret_cast<uint64_t*>(m_window + 16), m_count, __ATOMIC_RELEASE);
+        }
+
+        int m_fd = -1;
+        char* m_window = nullptr;
+        uint64_t m_window_offset = 0;
+        uint64_t m_count = 0;
+    };
+}
+
+#endif
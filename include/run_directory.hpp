@@ -0,0 +1,88 @@
+#ifndef SOFI_RUN_DIRECTORY_HPP
+#define SOFI_RUN_DIRECTORY_HPP
+
+#include <string>
+#include <cerrno>
+#include <vector>
+#include <cstdint>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "output_compare.hpp"
+
+namespace sofi {
+    struct file_digest { //what the debugee left in an output file
+        bool exists = false;
+        uint64_t size = 0;
+        uint64_t hash = fnv1a(nullptr, 0);
+
+        bool operator==(const file_digest& other) const { return exists == other.exists && size == other.size && hash == other.hash; }
+        bool operator!=(const file_digest& other) const { return !(*this == other); }
+    };
+
+    inline file_digest digest_file(int fd) { //hashed in place through a mapping
+        file_digest d;
+        struct stat st;
+        d.exists = true;
+        d.size = fstat(fd, &st) == 0 ? st.st_size : 0;
+        void* map = d.size ? mmap(nullptr, d.size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        if (map != MAP_FAILED) {
+            d.hash = fnv1a(static_cast<const char*>(map), d.size);
+            munmap(map, d.size);
+        }
+        return d;
+    }
+
+    /*
+    Working directory of one debugee, so that parallel runs don't overwrite each other's files. It's meant to live on a tmpfs
+    (/dev/shm by default), so that output files never reach a disk. Everything in it is deleted with it.
+    */
+    class run_directory {
+    public:
+        run_directory() = default;
+        run_directory(const run_directory&) = delete;
+        run_directory& operator=(const run_directory&) = delete;
+        ~run_directory() { remove(); }
+
+        bool create(const std::string& parent, const std::string& name) {
+            m_path = parent + "/" + name;
+            if (mkdir(m_path.c_str(), 0755) == -1 && errno != EEXIST) {
+                m_path = "";
+                return false;
+            }
+            return true;
+        }
+
+        file_digest digest(const std::string& file) const {
+            int fd = open((m_path + "/" + file).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return file_digest{};
+            auto d = digest_file(fd);
+            close(fd);
+            return d;
+        }
+
+        void clear() { //deletes everything in the directory, and keeps it for the next run
+            if (m_path == "") return;
+            nftw(m_path.c_str(), [](const char* path, const struct stat*, int, FTW* ftw) {
+                if (ftw->level > 0) ::remove(path); // children come first with FTW_DEPTH
+                return 0;
+            }, 16, FTW_DEPTH | FTW_PHYS);
+        }
+
+        void remove() {
+            clear();
+            if (m_path != "") rmdir(m_path.c_str());
+            m_path = "";
+        }
+
+        bool is_created() const { return m_path != ""; }
+        auto path() const -> const std::string& { return m_path; }
+    private:
+        std::string m_path = "";
+    };
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef SOFI_SANDBOX_HPP
+#define SOFI_SANDBOX_HPP
+
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/sched.h>
+
+namespace sofi {
+    struct sandbox_profile { // limits of every debugee, so that one bad injection can't slow all the others down
+        bool core_dumps = false;
+        uint64_t cpu_seconds = 0; // RLIMIT_CPU, 0 for none
+        uint64_t address_space = 0; // RLIMIT_AS in bytes, 0 for none
+        std::string cgroup = ""; // cgroup v2 directory that receives a cgroup per run, none if empty
+        uint64_t memory_max = 0; // memory.max of the run's cgroup in bytes, 0 for none
+        uint64_t pids_max = 0; // pids.max of the run's cgroup, 0 for none
+    };
+
+    inline void apply_limits(const sandbox_profile& profile) { // in the debugee, before exec
+        if (!profile.core_dumps) {
+            rlimit core {0, 0};
+            setrlimit(RLIMIT_CORE, &core);
+        }
+        if (profile.cpu_seconds) { // SIGXCPU at the soft limit, SIGKILL a second later
+            rlimit cpu {profile.cpu_seconds, profile.cpu_seconds + 1};
+            setrlimit(RLIMIT_CPU, &cpu);
+        }
+        if (profile.address_space) {
+            rlimit as {profile.address_space, profile.address_space};
+            setrlimit(RLIMIT_AS, &as);
+        }
+    }
+
+    inline std::string missing_controllers(const sandbox_profile& profile) { //those the limits need that the cgroup doesn't enable for its children
+        std::ifstream in {profile.cgroup + "/cgroup.subtree_control"};
+        std::string enabled = " ", controller, missing = "";
+        while (in >> controller) enabled += controller + " ";
+        if (profile.memory_max && enabled.find(" memory ") == std::string::npos) missing += " memory";
+        if (profile.pids_max && enabled.find(" pids ") == std::string::npos) missing += " pids";
+        return missing;
+    }
+
+    class run_cgroup { //a cgroup of its own for one debugee, removed once the debugee has been reaped
+    public:
+        run_cgroup() = default;
+        run_cgroup(const run_cgroup&) = delete;
+        run_cgroup& operator=(const run_cgroup&) = delete;
+        ~run_cgroup() { remove(); }
+
+        bool create(const sandbox_profile& profile, const std::string& name) {
+            m_path = profile.cgroup + "/" + name;
+            if (mkdir(m_path.c_str(), 0755) == -1 && errno != EEXIST) {
+                m_path = "";
+                return false;
+            }
+            if (profile.memory_max) {
+                write("memory.max", std::to_string(profile.memory_max));
+                write("memory.swap.max", "0"); // swapping would slow down the whole host instead
+            }
+            if (profile.pids_max) {
+                write("pids.max", std::to_string(profile.pids_max));
+            }
+            m_fd = open(m_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            return m_fd >= 0;
+        }
+
+        pid_t fork_into() { //the child starts inside the cgroup, so that even its first allocation is accounted. -1 with errno if it can't
+            if (m_fd >= 0) {
+                clone_args args {};
+                args.flags = CLONE_INTO_CGROUP;
+                args.exit_signal = SIGCHLD;
+                args.cgroup = m_fd;
+                auto pid = syscall(SYS_clone3, &args, sizeof(args));
+                if (pid >= 0) return pid;
+            }
+            pid_t pid = fork(); // e.g. before Linux 5.7, or EPERM across a delegation boundary
+            if (pid > 0 && m_fd >= 0 && !move(pid)) { // moved in while it waits at its exec for its tracer, before any of its code runs
+                int error = errno;
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+                errno = error;
+                return -1;
+            }
+            return pid;
+        }
+
+        bool memory_limit_hit() const { return event("memory.events", "oom_kill") > 0; }
+        bool pids_limit_hit() const { return event("pids.events", "max") > 0; }
+        bool is_created() const { return m_fd >= 0; }
+    private:
+        bool move(pid_t pid) const { //errno set if it fails
+            int fd = openat(m_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+            if (fd == -1) return false;
+            auto s = std::to_string(pid);
+            bool moved = ::write(fd, s.data(), s.size()) == static_cast<ssize_t>(s.size());
+            int error = errno;
+            close(fd);
+            errno = error;
+            return moved;
+        }
+
+        void write(const std::string& file, const std::string& value) const {
+            std::ofstream out {m_path + "/" + file};
+            out << value;
+        }
+
+        uint64_t event(const std::string& file, const std::string& key) const { //a counter of a flat keyed file, 0 if there is none
+            if (m_path == "") return 0;
+            std::ifstream in {m_path + "/" + file};
+            std::string k;
+            uint64_t value;
+            while (in >> k >> value) {
+                if (k == key) return value;
+            }
+            return 0;
+        }
+
+        void remove() {
+            if (m_fd >= 0) close(m_fd);
+            if (m_path != "") rmdir(m_path.c_str());
+            m_fd = -1;
+            m_path = "";
+        }
+
+        std::string m_path = "";
+        int m_fd = -1;
+    };
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef SOFI_SITE_STATS_HPP
+#define SOFI_SITE_STATS_HPP
+
+#include <map>
+#include <cmath>
+#include <csignal>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+#include "dwarf/dwarf++.hh"
+
+namespace sofi {
+    /*
+    Injection sites: the rows of the line table, sorted by DWARF address, each with its source file, line and function.
+    A fault injected anywhere between two rows belongs to the first one. It's built once, then only read.
+    */
+    class site_table {
+    public:
+        static constexpr uint32_t none = ~0u;
+
+        struct site {
+            uint64_t addr;
+            uint32_t file; // index into files(), 'none' past the end of a sequence
+            uint32_t line;
+            uint32_t function; // index into functions(), 'none' outside of any
+        };
+
+        void load(const dwarf::dwarf& dw) {
+            std::vector<std::pair<uint64_t, std::pair<uint64_t, uint32_t>>> ranges; // function address ranges
+            for (const auto& cu : dw.compilation_units()) {
+                for (const auto& die : cu.root()) {
+                    if (die.tag != dwarf::DW_TAG::subprogram || !die.has(dwarf::DW_AT::name) || !die.has(dwarf::DW_AT::low_pc)) continue;
+                    try {
+                        ranges.push_back({dwarf::at_low_pc(die), {dwarf::at_high_pc(die), intern(m_functions, m_function_index, dwarf::at_name(die))}});
+                    }
+                    catch (const std::exception&) {} // no high_pc
+                }
+                for (const auto& entry : cu.get_line_table()) {
+                    if (entry.end_sequence) {
+                        m_sites.push_back(site{entry.address, none, 0, none});
+                        continue;
+                    }
+                    m_sites.push_back(site{entry.address, intern(m_files, m_file_index, entry.file->path), entry.line, none});
+                }
+            }
+            // At an address shared by the end of a sequence and the start of the next, the row of the next one is kept.
+            std::stable_sort(m_sites.begin(), m_sites.end(), [](const site& a, const site& b) {
+                return a.addr < b.addr || (a.addr == b.addr && a.file != none && b.file == none);
+            });
+            m_sites.erase(std::unique(m_sites.begin(), m_sites.end(), [](const site& a, const site& b) { return a.addr == b.addr; }), m_sites.end());
+
+            std::sort(ranges.begin(), ranges.end());
+            auto r = ranges.begin();
+            for (auto& s : m_sites) { // both are sorted
+                while (r != ranges.end() && r->second.first <= s.addr) ++r;
+                if (r != ranges.end() && r->first <= s.addr) s.function = r->second.second;
+            }
+        }
+
+        auto find(uint64_t addr) const -> long { //index of the site holding addr, -1 if none
+            auto it = std::upper_bound(m_sites.begin(), m_sites.end(), addr, [](uint64_t a, const site& s) { return a < s.addr; });
+            if (it == m_sites.begin() || std::prev(it)->file == none) return -1;
+            return std::prev(it) - m_sites.begin();
+        }
+
+        auto size() const -> std::size_t { return m_sites.size(); }
+        auto operator[](std::size_t i) const -> const site& { return m_sites[i]; }
+        auto file(uint32_t i) const -> const std::string& { return m_files[i]; }
+        auto function(uint32_t i) const -> std::string { return i == none ? "?" : m_functions[i]; }
+    private:
+        static uint32_t intern(std::vector<std::string>& names, std::unordered_map<std::string, uint32_t>& index, const std::string& name) {
+            auto it = index.find(name);
+            if (it != index.end()) return it->second;
+            index.emplace(name, names.size());
+            names.push_back(name);
+            return names.size() - 1;
+        }
+
+        std::vector<site> m_sites;
+        std::vector<std::string> m_files;
+        std::unordered_map<std::string, uint32_t> m_file_index;
+        std::vector<std::string> m_functions;
+        std::unordered_map<std::string, uint32_t> m_function_index;
+    };
+
+    /*
+    What faults injected at each site led to, in one flat array of counters indexed by site and by counter.
+    Workers add to it with relaxed atomic increments, without any lock; it's only read once they are all done.
+    */
+    class site_stats {
+    public:
+        enum counter {
+            injections,
+            masked,     // same output as the golden run
+            sdc,        // silent data corruption
+            crash,      // fatal signal, also counted per signal below
+            hang,       // timeout or CPU time limit
+            detected,   // non zero exit status, other limits, aborted
+            perf_fault, // on top of one of the above
+            segv, bus, ill, fpe, abrt, trap, other_signal,
+            n_counters
+        };
+
+        explicit site_stats(std::size_t sites) : m_sites{sites}, m_counters{new std::atomic<uint64_t>[sites * n_counters]()} {}
+
+        void add(std::size_t site, counter c) { m_counters[site * n_counters + c].fetch_add(1, std::memory_order_relaxed); }
+        auto get(std::size_t site, counter c) const -> uint64_t { return m_counters[site * n_counters + c].load(std::memory_order_relaxed); }
+        auto size() const -> std::size_t { return m_sites; }
+
+        static counter signal_counter(int signo) {
+            switch (signo) {
+            case SIGSEGV: return segv;
+            case SIGBUS: return bus;
+            case SIGILL: return ill;
+            case SIGFPE: return fpe;
+            case SIGABRT: return abrt;
+            case SIGTRAP: return trap;
+            default: return other_signal;
+            }
+        }
+    private:
+        std::size_t m_sites;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_counters;
+    };
+
+    struct site_summary { //counters of several sites added up, e.g. of one source line or one function
+        uint64_t counts[site_stats::n_counters] = {};
+
+        void add(const site_stats& stats, std::size_t site) {
+            for (int c = 0; c < site_stats::n_counters; ++c) {
+                counts[c] += stats.get(site, static_cast<site_stats::counter>(c));
+            }
+        }
+        auto operator[](site_stats::counter c) const -> uint64_t { return counts[c]; }
+    };
+
+    struct rate_interval { //a proportion with its 95% Wilson score interval, sound even for few injections and rates near 0 or 1
+        double rate = 0, low = 0, high = 0;
+
+        rate_interval(uint64_t k, uint64_t n) {
+            if (n == 0) return;
+            const double z = 1.96;
+            double p = static_cast<double>(k) / n;
+            double d = 1 + z * z / n;
+            double center = (p + z * z / (2 * n)) / d;
+            double half = z * std::sqrt(p * (1 - p) / n + z * z / (4.0 * n * n)) / d;
+            rate = p;
+            low = std::max(0.0, center - half);
+            high = std::min(1.0, center + half);
+        }
+    };
+}
+
+#endif
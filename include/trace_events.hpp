@@ -0,0 +1,76 @@
+#ifndef SOFI_TRACE_EVENTS_HPP
+#define SOFI_TRACE_EVENTS_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "tracer_profile.hpp"
+
+namespace sofi {
+    struct trace_slice { //one phase of a run, or the whole run if 'phase' is negative
+        int64_t start; // steady clock nanoseconds
+        int64_t end;
+        int phase;
+        long tid;
+        pid_t pid;
+        uint64_t site; // DWARF address of the injection, 0 if none
+        std::string outcome;
+    };
+
+    /*
+    Slices of the runs made on one track (a worker, or a golden run). Only the run in progress on that track appends to it,
+    so it needs no lock; the buffers are written out together once every run is over.
+    */
+    class trace_buffer {
+    public:
+        void add_run(long tid, pid_t pid, uint64_t site, const std::string& outcome, const phase_clock& clock) {
+            if (clock.intervals().empty()) return;
+            m_slices.push_back(trace_slice{clock.intervals().front().start, clock.intervals().back().end, -1, tid, pid, site, outcome});
+            for (const auto& i : clock.intervals()) {
+                m_slices.push_back(trace_slice{i.start, i.end, static_cast<int>(i.p), tid, pid, site, ""});
+            }
+        }
+
+        auto slices() const -> const std::vector<trace_slice>& { return m_slices; }
+    private:
+        std::vector<trace_slice> m_slices;
+    };
+
+    /*
+    Writes the buffers in the Chrome trace event format, which chrome://tracing and Perfetto open: one thread per track,
+    named after it, with complete ("X") events in microseconds from the earliest one.
+    */
+    inline bool write_chrome_trace(const std::string& path, const std::vector<trace_buffer>& buffers, const std::vector<std::string>& names) {
+        std::ofstream out {path};
+        if (!out) return false;
+        int64_t origin = INT64_MAX;
+        for (const auto& b : buffers) {
+            for (const auto& s : b.slices()) origin = std::min(origin, s.start);
+        }
+        auto micros = [&](int64_t ns) { return static_cast<double>(ns - origin) / 1000; };
+
+        out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"sofi\"}}";
+        for (std::size_t t = 0; t < buffers.size(); ++t) {
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"" << names[t] << "\"}}";
+            out << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"sort_index\":" << t << "}}";
+            for (const auto& s : buffers[t].slices()) {
+                bool run = s.phase < 0;
+                out << ",\n{\"name\":\"" << (run ? "run " + std::to_string(s.tid) : to_string(static_cast<phase>(s.phase)))
+                    << "\",\"cat\":\"" << (run ? "run" : "phase") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t
+                    << ",\"ts\":" << micros(s.start) << ",\"dur\":" << micros(s.end) - micros(s.start)
+                    << ",\"args\":{\"tid\":" << s.tid << ",\"pid\":" << s.pid << ",\"site\":\"0x" << std::hex << s.site << std::dec << "\"";
+                if (run) out << ",\"outcome\":\"" << s.outcome << "\"";
+                out << "}}";
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+}
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef SOFI_TRACER_PROFILE_HPP
+#define SOFI_TRACER_PROFILE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+namespace sofi {
+    enum class phase {
+        pipe_setup,        // output pipes or memfds, cgroup, working directory
+        fork_exec,         // until the debugee exists
+        first_stop,        // until it stops on exec
+        symbol_resolution, // ELF and DWARF loading, address lookups
+        breakpoint_arming, // breakpoints, watchpoints and counters of the trigger
+        run_to_trigger,    // until the injection point
+        fault_apply,       // the corruption itself
+        post_fault_run,    // until the debugee terminates
+        output_drain,      // collecting and comparing its output
+        classification,    // outcome, performance faults, result record
+    };
+
+    static constexpr std::size_t n_phases = 10;
+
+    inline std::string to_string (phase p) {
+        switch (p) {
+        case phase::pipe_setup: return "pipe setup";
+        case phase::fork_exec: return "fork/exec";
+        case phase::first_stop: return "first stop";
+        case phase::symbol_resolution: return "symbol resolution";
+        case phase::breakpoint_arming: return "breakpoint arming";
+        case phase::run_to_trigger: return "run to trigger";
+        case phase::fault_apply: return "fault apply";
+        case phase::post_fault_run: return "post-fault run";
+        case phase::output_drain: return "output drain";
+        case phase::classification: return "classification";
+        }
+        __builtin_unreachable();
+    }
+
+    /*
+    HDR-style histogram of latencies in nanoseconds: values below 2^sub_bits have a bucket each, and every power of two above
+    is split into 2^sub_bits buckets, so quantiles are within 1/2^sub_bits of the truth over the whole range.
+    Recording is one relaxed atomic increment, so it can be read (and merged) while workers record into it.
+    */
+    class latency_histogram {
+    public:
+        static constexpr int sub_bits = 5;
+        static constexpr std::size_t n_buckets = (64 - sub_bits + 1) << sub_bits;
+
+        void record(uint64_t value) {
+            m_buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_sum.fetch_add(value, std::memory_order_relaxed);
+            auto max = m_max.load(std::memory_order_relaxed);
+            while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+        }
+
+        void merge(const latency_histogram& other) { //not atomic as a whole, fine for reporting
+            for (std::size_t i = 0; i < n_buckets; ++i) {
+                auto n = other.m_buckets[i].load(std::memory_order_relaxed);
+                if (n) m_buckets[i].fetch_add(n, std::memory_order_relaxed);
+            }
+            m_count.fetch_add(other.count(), std::memory_order_relaxed);
+            m_sum.fetch_add(other.sum(), std::memory_order_relaxed);
+            if (other.max() > max()) m_max.store(other.max(), std::memory_order_relaxed);
+        }
+
+        auto quantile(double q) const -> uint64_t { //midpoint of the bucket holding it, 0 if empty
+            uint64_t total = 0;
+            for (const auto& b : m_buckets) total += b.load(std::memory_order_relaxed);
+            if (total == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(q * total + 0.5), seen = 0;
+            if (rank == 0) rank = 1;
+            for (std::size_t i = 0; i < n_buckets; ++i) {
+                seen += m_buckets[i].load(std::memory_order_relaxed);
+                if (seen >= rank) return std::min(lowest(i) + (width(i) - 1) / 2, max());
+            }
+            return max();
+        }
+
+        auto count() const -> uint64_t { return m_count.load(std::memory_order_relaxed); }
+        auto sum() const -> uint64_t { return m_sum.load(std::memory_order_relaxed); }
+        auto max() const -> uint64_t { return m_max.load(std::memory_order_relaxed); }
+    private:
+        static std::size_t bucket(uint64_t value) {
+            if (value < (1u << sub_bits)) return value;
+            int shift = 63 - __builtin_clzll(value) - sub_bits;
+            return (static_cast<std::size_t>(shift + 1) << sub_bits) + ((value >> shift) - (1u << sub_bits));
+        }
+        static uint64_t lowest(std::size_t i) {
+            if (i < (1u << sub_bits)) return i;
+            int shift = (i >> sub_bits) - 1;
+            return ((i & ((1u << sub_bits) - 1)) + (1u << sub_bits)) << shift;
+        }
+        static uint64_t width(std::size_t i) { return i < (2u << sub_bits) ? 1 : 1ull << ((i >> sub_bits) - 1); }
+
+        std::array<std::atomic<uint64_t>, n_buckets> m_buckets {};
+        std::atomic<uint64_t> m_count {0};
+        std::atomic<uint64_t> m_sum {0};
+        std::atomic<uint64_t> m_max {0};
+    };
+
+    struct tracer_counters { //what the tracer asked of the kernel
+        std::atomic<uint64_t> ptrace_calls {0};
+        std::atomic<uint64_t> waits {0};
+        std::atomic<uint64_t> bytes_read {0}; // from the debugee: peeks, registers, siginfo, process_vm_readv, /proc/pid/mem
+        std::atomic<uint64_t> bytes_written {0};
+
+        void merge(const tracer_counters& other) {
+            ptrace_calls += other.ptrace_calls.load(std::memory_order_relaxed);
+            waits += other.waits.load(std::memory_order_relaxed);
+            bytes_read += other.bytes_read.load(std::memory_order_relaxed);
+            bytes_written += other.bytes_written.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct worker_profile { //of one worker: only its own runs write to it, anyone may read it at any time
+        std::array<latency_histogram, n_phases> phases;
+        tracer_counters counters;
+        std::atomic<uint64_t> runs {0};
+
+        void merge(const worker_profile& other) {
+            for (std::size_t p = 0; p < n_phases; ++p) phases[p].merge(other.phases[p]);
+            counters.merge(other.counters);
+            runs += other.runs.load(std::memory_order_relaxed);
+        }
+    };
+
+    inline tracer_counters*& current_counters() { // of the worker running the current thread's debugee, if any
+        thread_local tracer_counters* counters = nullptr; // one per thread, whichever translation unit asks
+        return counters;
+    }
+
+    inline void count_transfer(uint64_t read, uint64_t written) {
+        auto counters = current_counters();
+        if (!counters) return;
+        if (read) counters->bytes_read.fetch_add(read, std::memory_order_relaxed);
+        if (written) counters->bytes_written.fetch_add(written, std::memory_order_relaxed);
+    }
+
+    inline void* ptrace_argument(std::nullptr_t) { return nullptr; }
+    template <typename T>
+    void* ptrace_argument(T* p) { return const_cast<void*>(static_cast<const void*>(p)); }
+    template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+    void* ptrace_argument(T value) { return reinterpret_cast<void*>(static_cast<uintptr_t>(value)); }
+
+    /*
+    Every ptrace call of SOFI resolves to this overload rather than to the C library's variadic ptrace, which is a worse match,
+    so that the calls and the bytes they move are counted.
+    */
+    template <typename A, typename D>
+    long ptrace(__ptrace_request request, pid_t pid, A addr, D data) {
+        if (auto counters = current_counters()) {
+            counters->ptrace_calls.fetch_add(1, std::memory_order_relaxed);
+            switch (request) {
+            case PTRACE_PEEKDATA: case PTRACE_PEEKTEXT: case PTRACE_PEEKUSER: count_transfer(sizeof(long), 0); break;
+            case PTRACE_POKEDATA: case PTRACE_POKETEXT: case PTRACE_POKEUSER: count_transfer(0, sizeof(long)); break;
+            case PTRACE_GETREGS: count_transfer(sizeof(user_regs_struct), 0); break;
+            case PTRACE_SETREGS: count_transfer(0, sizeof(user_regs_struct)); break;
+            case PTRACE_GETFPREGS: count_transfer(sizeof(user_fpregs_struct), 0); break;
+            case PTRACE_SETFPREGS: count_transfer(0, sizeof(user_fpregs_struct)); break;
+            case PTRACE_GETSIGINFO: count_transfer(sizeof(siginfo_t), 0); break;
+            default: break;
+            }
+        }
+        return ::ptrace(request, pid, ptrace_argument(addr), ptrace_argument(data));
+    }
+
+    /*
+    Splits a run into phases. A phase may be entered several times (e.g. symbol lookups before and after the first stop):
+    its time adds up, and it's recorded once per run. When asked to, it also keeps every interval, in order, for a timeline.
+    */
+    class phase_clock {
+    public:
+        struct interval {
+            phase p;
+            int64_t start; // steady clock nanoseconds
+            int64_t end;
+        };
+
+        explicit phase_clock(bool keep_intervals = false) : m_keep_intervals{keep_intervals} {}
+
+        void enter(phase p) {
+            auto now = std::chrono::steady_clock::now();
+            if (m_running) close(now);
+            m_current = static_cast<std::size_t>(p);
+            m_entered[m_current] = true;
+            m_running = true;
+            m_since = now;
+        }
+
+        void stop() {
+            if (m_running) close(std::chrono::steady_clock::now());
+            m_running = false;
+        }
+
+        void record(worker_profile& profile) {
+            stop();
+            for (std::size_t p = 0; p < n_phases; ++p) {
+                if (m_entered[p]) profile.phases[p].record(std::chrono::duration_cast<std::chrono::nanoseconds>(m_elapsed[p]).count());
+            }
+            profile.runs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        auto elapsed(phase p) const -> std::chrono::steady_clock::duration { return m_elapsed[static_cast<std::size_t>(p)]; }
+        bool entered(phase p) const { return m_entered[static_cast<std::size_t>(p)]; }
+        auto intervals() const -> const std::vector<interval>& { return m_intervals; }
+    private:
+        void close(std::chrono::steady_clock::time_point now) { //ends the interval of the current phase
+            m_elapsed[m_current] += now - m_since;
+            if (m_keep_intervals) {
+                m_intervals.push_back(interval{static_cast<phase>(m_current), nanoseconds(m_since), nanoseconds(now)});
+            }
+        }
+        static int64_t nanoseconds(std::chrono::steady_clock::time_point t) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        }
+
+        std::array<std::chrono::steady_clock::duration, n_phases> m_elapsed {};
+        std::array<bool, n_phases> m_entered {};
+        std::size_t m_current = 0;
+        bool m_running = false;
+        std::chrono::steady_clock::time_point m_since;
+        bool m_keep_intervals;
+        std::vector<interval> m_intervals;
+    };
+}
+
+#endif
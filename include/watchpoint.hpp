@@ -0,0 +1,82 @@
+#ifndef SOFI_WATCHPOINT_HPP
+#define SOFI_WATCHPOINT_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+
+#include "tracer_profile.hpp"
+
+namespace sofi {
+    enum class watch_condition {
+        execute = 0b00,    // Break on instruction fetch
+        write = 0b01,      // Break on data writes
+        read_write = 0b11, // Break on data reads or writes
+    };
+
+    static constexpr unsigned n_watchpoints = 4; // DR0 - DR3
+
+    class watchpoint {
+    public:
+        watchpoint() = default;
+        watchpoint(pid_t pid, std::intptr_t addr, unsigned slot, watch_condition cond, unsigned len)
+            : m_pid{pid}, m_addr{addr}, m_slot{slot}, m_cond{cond}, m_len{len}, m_enabled{false} {}
+
+        void enable() {
+            ptrace(PTRACE_POKEUSER, m_pid, debugreg_offset(m_slot), m_addr);
+
+            auto dr7 = static_cast<uint64_t>(ptrace(PTRACE_PEEKUSER, m_pid, debugreg_offset(7), nullptr));
+            dr7 &= ~(uint64_t{0b1111} << (16 + m_slot * 4)); //clear RW and LEN bits of the slot
+            dr7 |= (static_cast<uint64_t>(m_cond) | (len_bits(m_len) << 2)) << (16 + m_slot * 4);
+            dr7 |= uint64_t{1} << (m_slot * 2); //local enable
+            ptrace(PTRACE_POKEUSER, m_pid, debugreg_offset(7), dr7);
+
+            m_enabled = true;
+        }
+
+        void disable() {
+            auto dr7 = static_cast<uint64_t>(ptrace(PTRACE_PEEKUSER, m_pid, debugreg_offset(7), nullptr));
+            dr7 &= ~(uint64_t{1} << (m_slot * 2));
+            ptrace(PTRACE_POKEUSER, m_pid, debugreg_offset(7), dr7);
+
+            m_enabled = false;
+        }
+
+        bool is_enabled() const { return m_enabled; }
+
+        bool is_hit() const { //DR6 reports which slot caused the last debug exception
+            auto dr6 = ptrace(PTRACE_PEEKUSER, m_pid, debugreg_offset(6), nullptr);
+            return dr6 & (1 << m_slot);
+        }
+
+        void clear_status() {
+            ptrace(PTRACE_POKEUSER, m_pid, debugreg_offset(6), 0);
+        }
+
+        auto get_address() const -> std::intptr_t { return m_addr; }
+        auto get_slot() const -> unsigned { return m_slot; }
+    private:
+        static std::size_t debugreg_offset(unsigned n) {
+            return offsetof(struct user, u_debugreg) + n * sizeof(((struct user*)0)->u_debugreg[0]);
+        }
+
+        static uint64_t len_bits(unsigned len) { //the length field is not a plain size encoding
+            switch (len) {
+            case 2: return 0b01;
+            case 4: return 0b11;
+            case 8: return 0b10;
+            default: return 0b00;
+            }
+        }
+
+        pid_t m_pid;
+        std::intptr_t m_addr;
+        unsigned m_slot;
+        watch_condition m_cond;
+        unsigned m_len;  //1, 2, 4 or 8 bytes; the address must be aligned to it
+        bool m_enabled;
+    };
+}
+
+#endif
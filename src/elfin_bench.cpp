@@ -0,0 +1,246 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SOFI_NO_MAIN
+#include "sofi.cpp" // SOFI is one translation unit, its lookups come with it
+
+/*
+Microbenchmarks of the libelfin queries SOFI is built on, and of SOFI's own lookups over them, on one binary:
+itself by default (SOFI's code, with its DWARF 4), or any binary with DWARF 2 to 4 given on the command line.
+Every query is repeated for at least --min-time, and reported per operation.
+*/
+
+namespace {
+    struct bench_result {
+        string name;
+        uint64_t ops = 0; // operations timed in total
+        double nsPerOp = 0;
+    };
+
+    volatile uint64_t sink; // keeps results alive
+
+    bench_result measure(const string& name, milliseconds minTime, const function<uint64_t()>& f){ // f returns the operations it made
+        bench_result r;
+        r.name = name;
+        nanoseconds elapsed {0};
+        for (int calls = 0; calls < 3 || elapsed < minTime; calls++) {
+            auto start = steady_clock::now();
+            r.ops += f();
+            elapsed += steady_clock::now() - start;
+        }
+        r.nsPerOp = r.ops ? static_cast<double>(elapsed.count()) / r.ops : 0;
+        cout<<left<<setw(34)<<r.name<<right<<setw(12)<<r.ops<<setw(16)<<fixed<<setprecision(1)<<r.nsPerOp<<endl;
+        return r;
+    }
+
+    struct loaded { //a binary and its debug information, as the debugger loads them
+        elf::elf ef;
+        dwarf::dwarf dw;
+
+        explicit loaded(const string& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            ef = elf::elf{elf::create_mmap_loader(fd)};
+            dw = dwarf::dwarf{dwarf::elf::create_loader(ef)};
+        }
+    };
+
+    uint64_t walk(const dwarf::die& die){ //DIEs in the tree under 'die', itself included
+        uint64_t n = 1;
+        for (const auto& child : die) n += walk(child);
+        return n;
+    }
+
+    void usage(const char* name){
+        cout<<"Usage: "<<name<<" [options] [BINARY]"<<endl
+            <<"  --min-time=MS                    time every query for at least MS milliseconds (default 200)"<<endl
+            <<"  --samples=N                      names, addresses and lines looked up (default 256)"<<endl
+            <<"  --csv=FILE                       write the results into the CSV file FILE"<<endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string path = "/proc/self/exe", csv = "";
+    milliseconds minTime {200};
+    size_t samples = 256;
+    for (int i = 1; i < argc; i++) {
+        string opt = argv[i];
+        auto eq = opt.find('=');
+        string name = opt.substr(0, eq);
+        string value = eq == string::npos ? "" : opt.substr(eq + 1);
+        if (name == "--min-time" && value != "") minTime = milliseconds(std::stoi(value));
+        else if (name == "--samples" && value != "") samples = std::max(1, std::stoi(value));
+        else if (name == "--csv" && value != "") csv = value;
+        else if (opt.compare(0, 2, "--") != 0) path = opt;
+        else {
+            usage(argv[0]);
+            return opt == "--help" ? 0 : 1;
+        }
+    }
+
+    loaded bin {path};
+    debugger dbg {path, 0}; // never started: only its symbol lookups are used, on DWARF addresses
+    vector<dwarf::die> functions; // named subprograms with an address range
+    vector<string> functionNames;
+    vector<pair<const dwarf::compilation_unit*, uint64_t>> addresses; // line table rows, with their unit
+    vector<pair<string, unsigned>> lines;
+    uint64_t units = 0, topLevel = 0, symbols = 0, rows = 0;
+    for (const auto& cu : bin.dw.compilation_units()) {
+        units++;
+        for (const auto& die : cu.root()) {
+            topLevel++;
+            if (die.tag == dwarf::DW_TAG::subprogram && die.has(dwarf::DW_AT::name) && die.has(dwarf::DW_AT::low_pc)) {
+                functions.push_back(die);
+            }
+        }
+        for (const auto& entry : cu.get_line_table()) {
+            rows++;
+            if (!entry.end_sequence) addresses.push_back({&cu, entry.address});
+            if (entry.is_stmt && !entry.end_sequence) lines.push_back({at_name(cu.root()), entry.line});
+        }
+    }
+    for (auto& sec : bin.ef.sections()) {
+        if (sec.get_hdr().type != elf::sht::symtab && sec.get_hdr().type != elf::sht::dynsym) continue;
+        for (auto sym : sec.as_symtab()) {
+            symbols++;
+            sink = sym.get_name().size();
+        }
+    }
+    if (functions.empty() || addresses.empty()) {
+        cerr << "No usable DWARF in " << path << " (libelfin reads DWARF 2 to 4)" << endl;
+        return 1;
+    }
+    auto pick = [samples](size_t size, size_t i) { // the i-th of up to 'samples' evenly spread indices
+        auto n = std::min(size, samples);
+        return (i % n) * size / n;
+    };
+    for (const auto& f : functions) functionNames.push_back(at_name(f));
+    cout<<path<<": "<<units<<" compilation units, "<<topLevel<<" top level DIEs, "<<functions.size()<<" functions, "<<rows
+        <<" line table rows, "<<symbols<<" symbols"<<endl;
+    cout<<left<<setw(34)<<"query"<<right<<setw(12)<<"operations"<<setw(16)<<"ns/operation"<<endl;
+
+    vector<bench_result> results;
+    size_t next = 0;
+    results.push_back(measure("elf+dwarf load", minTime, [&] {
+        loaded fresh {path};
+        sink = fresh.dw.compilation_units().size();
+        return 1;
+    }));
+    results.push_back(measure("line tables decode (fresh)", minTime, [&] {
+        loaded fresh {path};
+        uint64_t n = 0;
+        for (const auto& cu : fresh.dw.compilation_units()) {
+            for (const auto& entry : cu.get_line_table()) n += entry.line != 0;
+        }
+        sink = n;
+        return rows;
+    }));
+    results.push_back(measure("compilation_units", minTime, [&] {
+        uint64_t n = 0;
+        for (const auto& cu : bin.dw.compilation_units()) n += cu.get_section_offset() != 0;
+        sink = n;
+        return units;
+    }));
+    results.push_back(measure("die iteration (top level)", minTime, [&] {
+        uint64_t n = 0;
+        for (const auto& cu : bin.dw.compilation_units()) {
+            for (const auto& die : cu.root()) n += die.tag == dwarf::DW_TAG::subprogram;
+        }
+        sink = n;
+        return topLevel;
+    }));
+    results.push_back(measure("die iteration (whole tree)", minTime, [&] {
+        uint64_t n = 0;
+        for (const auto& cu : bin.dw.compilation_units()) n += walk(cu.root());
+        sink = n;
+        return n;
+    }));
+    results.push_back(measure("at_name", minTime, [&] {
+        uint64_t n = 0;
+        for (const auto& f : functions) n += at_name(f).size();
+        sink = n;
+        return functions.size();
+    }));
+    results.push_back(measure("die_pc_range", minTime, [&] {
+        uint64_t n = 0;
+        for (const auto& cu : bin.dw.compilation_units()) {
+            try {
+                n += die_pc_range(cu.root()).contains(addresses[0].second);
+            }
+            catch (const std::exception&) {} // no range
+        }
+        sink = n;
+        return units;
+    }));
+    results.push_back(measure("line_table::find_address", minTime, [&] {
+        auto& a = addresses[pick(addresses.size(), next++)];
+        auto& lt = a.first->get_line_table();
+        sink = lt.find_address(a.second) != lt.end();
+        return 1;
+    }));
+    results.push_back(measure("symtab iteration", minTime, [&] {
+        uint64_t n = 0;
+        for (auto& sec : bin.ef.sections()) {
+            if (sec.get_hdr().type != elf::sht::symtab && sec.get_hdr().type != elf::sht::dynsym) continue;
+            for (auto sym : sec.as_symtab()) n += sym.get_name().size();
+        }
+        sink = n;
+        return symbols;
+    }));
+    results.push_back(measure("sofi get_function_from_name", minTime, [&] {
+        sink = dbg.get_function_from_name(functionNames[pick(functionNames.size(), next++)]).get_section_offset();
+        return 1;
+    }));
+    results.push_back(measure("sofi get_function_from_pc", minTime, [&] {
+        try {
+            sink = dbg.get_function_from_pc(at_low_pc(functions[pick(functions.size(), next++)])).get_section_offset();
+        }
+        catch (const std::exception&) {} // e.g. a function without high_pc
+        return 1;
+    }));
+    results.push_back(measure("sofi get_line_entry_from_pc", minTime, [&] {
+        try {
+            sink = dbg.get_line_entry_from_pc(addresses[pick(addresses.size(), next++)].second)->line;
+        }
+        catch (const std::exception&) {}
+        return 1;
+    }));
+    results.push_back(measure("sofi get_address_at_source_line", minTime, [&] {
+        const auto& l = lines[pick(lines.size(), next++)];
+        intptr_t addr = 0;
+        dbg.get_address_at_source_line(l.first, l.second, addr);
+        sink = addr;
+        return 1;
+    }));
+    results.push_back(measure("sofi lookup_symbol", minTime, [&] {
+        sink = dbg.lookup_symbol(functionNames[pick(functionNames.size(), next++)]).size();
+        return 1;
+    }));
+    results.push_back(measure("sofi site_table::load", minTime, [&] {
+        site_table sites;
+        sites.load(bin.dw);
+        sink = sites.size();
+        return 1;
+    }));
+    site_table sites;
+    sites.load(bin.dw);
+    results.push_back(measure("sofi site_table::find", minTime, [&] {
+        sink = sites.find(addresses[pick(addresses.size(), next++)].second);
+        return 1;
+    }));
+
+    if (csv != "") {
+        std::ofstream out {csv};
+        out << "query,operations,ns_per_operation" << endl;
+        for (const auto& r : results) out << r.name << "," << r.ops << "," << r.nsPerOp << endl;
+        if (!out) cerr << "Cannot write " << csv << endl;
+    }
+    return 0;
+}
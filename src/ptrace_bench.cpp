@@ -0,0 +1,243 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <elf.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+
+using namespace std;
+using namespace std::chrono;
+
+/*
+Microbenchmark of the ptrace primitives SOFI could use, on the running kernel, against a forked tracee:
+memory access by PTRACE_PEEKDATA/POKEDATA, process_vm_readv/writev and /proc/pid/mem; registers by GETREGS and GETREGSET;
+breakpoint hits by int3 (stepped over and re-armed) and by a debug register; single-step and block-step stops.
+Its numbers are what SOFI's defaults are chosen from.
+*/
+
+namespace {
+    char buffer[1 << 20]; // same address in the tracee, which is a fork of this process
+    volatile uint64_t calls = 0;
+
+    __attribute__((noinline)) void bench_target(){ // breakpoints are set on its first instruction
+        calls = calls + 1;
+    }
+
+    struct bench_result {
+        string name;
+        size_t bytes = 0; // moved per call, 0 if it's not a transfer
+        uint64_t calls = 0;
+        double nsPerCall = 0;
+    };
+
+    vector<bench_result> results;
+    milliseconds minTime {100};
+
+    void measure(const string& name, size_t bytes, const function<bool()>& f){ // f makes one call, false if it failed
+        bench_result r;
+        r.name = name;
+        r.bytes = bytes;
+        nanoseconds elapsed {0};
+        while (r.calls < 16 || elapsed < minTime) {
+            auto start = steady_clock::now();
+            for (int i = 0; i < 16; i++) {
+                if (!f()) {
+                    cout<<left<<setw(36)<<name<<right<<setw(10)<<(bytes ? to_string(bytes) : "")<<"  failed: "<<strerror(errno)<<endl;
+                    return;
+                }
+            }
+            elapsed += steady_clock::now() - start;
+            r.calls += 16;
+        }
+        r.nsPerCall = static_cast<double>(elapsed.count()) / r.calls;
+        cout<<left<<setw(36)<<name<<right<<setw(10)<<(bytes ? to_string(bytes) : "")<<setw(14)<<fixed<<setprecision(1)<<r.nsPerCall;
+        if (bytes) cout<<setw(14)<<setprecision(1)<<bytes / r.nsPerCall * 1000<<" MB/s";
+        cout<<endl;
+        results.push_back(r);
+    }
+
+    bool wait_stop(pid_t pid){ // true if the tracee stopped
+        int status;
+        while (waitpid(pid, &status, 0) == -1) {
+            if (errno != EINTR) return false;
+        }
+        return WIFSTOPPED(status);
+    }
+
+    const bench_result* find_result(const string& name, size_t bytes){
+        for (const auto& r : results) {
+            if (r.name == name && r.bytes == bytes) return &r;
+        }
+        return nullptr;
+    }
+
+    string fastest(const vector<string>& names, size_t bytes){
+        const bench_result* best = nullptr;
+        for (const auto& n : names) {
+            auto r = find_result(n, bytes);
+            if (r && (!best || r->nsPerCall < best->nsPerCall)) best = r;
+        }
+        return best ? best->name : "none";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string csv = "";
+    for (int i = 1; i < argc; i++) {
+        string opt = argv[i];
+        auto eq = opt.find('=');
+        string name = opt.substr(0, eq);
+        string value = eq == string::npos ? "" : opt.substr(eq + 1);
+        if (name == "--min-time" && value != "") minTime = milliseconds(std::stoi(value));
+        else if (name == "--csv" && value != "") csv = value;
+        else {
+            cout<<"Usage: "<<argv[0]<<" [--min-time=MS] [--csv=FILE]"<<endl;
+            return opt == "--help" ? 0 : 1;
+        }
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) { // the tracee: stops for its tracer, then calls bench_target forever
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        raise(SIGSTOP);
+        while (true) bench_target();
+    }
+    if (pid < 0 || !wait_stop(pid)) {
+        perror("tracee");
+        return 1;
+    }
+    int mem = open(("/proc/" + to_string(pid) + "/mem").c_str(), O_RDWR | O_CLOEXEC);
+    vector<char> local(sizeof(buffer));
+    auto remote = reinterpret_cast<uintptr_t>(buffer);
+
+    cout<<left<<setw(36)<<"primitive"<<right<<setw(10)<<"bytes"<<setw(14)<<"ns/call"<<endl;
+    for (size_t size : {8, 64, 512, 4096, 65536}) {
+        measure("read PTRACE_PEEKDATA", size, [&] {
+            for (size_t o = 0; o < size; o += sizeof(long)) {
+                errno = 0;
+                long word = ptrace(PTRACE_PEEKDATA, pid, remote + o, nullptr);
+                if (errno) return false;
+                memcpy(local.data() + o, &word, sizeof(word));
+            }
+            return true;
+        });
+        measure("read process_vm_readv", size, [&] {
+            iovec l {local.data(), size}, r {buffer, size};
+            return process_vm_readv(pid, &l, 1, &r, 1, 0) == static_cast<ssize_t>(size);
+        });
+        measure("read /proc/pid/mem", size, [&] {
+            return pread(mem, local.data(), size, remote) == static_cast<ssize_t>(size);
+        });
+    }
+    for (size_t size : {8, 64, 512, 4096, 65536}) {
+        measure("write PTRACE_POKEDATA", size, [&] {
+            for (size_t o = 0; o < size; o += sizeof(long)) {
+                long word;
+                memcpy(&word, local.data() + o, sizeof(word));
+                if (ptrace(PTRACE_POKEDATA, pid, remote + o, word) == -1) return false;
+            }
+            return true;
+        });
+        measure("write process_vm_writev", size, [&] {
+            iovec l {local.data(), size}, r {buffer, size};
+            return process_vm_writev(pid, &l, 1, &r, 1, 0) == static_cast<ssize_t>(size);
+        });
+        measure("write /proc/pid/mem", size, [&] {
+            return pwrite(mem, local.data(), size, remote) == static_cast<ssize_t>(size);
+        });
+    }
+
+    user_regs_struct regs;
+    measure("registers PTRACE_GETREGS", 0, [&] {
+        return ptrace(PTRACE_GETREGS, pid, nullptr, &regs) == 0;
+    });
+    measure("registers PTRACE_GETREGSET", 0, [&] {
+        iovec io {&regs, sizeof(regs)};
+        return ptrace(PTRACE_GETREGSET, pid, reinterpret_cast<void*>(NT_PRSTATUS), &io) == 0;
+    });
+    measure("register PTRACE_PEEKUSER (rip)", 0, [&] {
+        errno = 0;
+        ptrace(PTRACE_PEEKUSER, pid, offsetof(user_regs_struct, rip), nullptr);
+        return errno == 0;
+    });
+    measure("registers PTRACE_SETREGS", 0, [&] {
+        return ptrace(PTRACE_SETREGS, pid, nullptr, &regs) == 0;
+    });
+    measure("registers PTRACE_SETREGSET", 0, [&] {
+        iovec io {&regs, sizeof(regs)};
+        return ptrace(PTRACE_SETREGSET, pid, reinterpret_cast<void*>(NT_PRSTATUS), &io) == 0;
+    });
+
+    auto target = reinterpret_cast<uintptr_t>(&bench_target);
+    errno = 0;
+    long original = ptrace(PTRACE_PEEKDATA, pid, target, nullptr);
+    long trapped = (original & ~0xffl) | 0xcc;
+    ptrace(PTRACE_POKEDATA, pid, target, trapped);
+    measure("breakpoint hit, int3", 0, [&] { // as the debugger does it: back up over the int3, step the original instruction, re-arm
+        if (ptrace(PTRACE_CONT, pid, nullptr, nullptr) == -1 || !wait_stop(pid)) return false;
+        ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+        regs.rip -= 1;
+        ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+        ptrace(PTRACE_POKEDATA, pid, target, original);
+        if (ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) == -1 || !wait_stop(pid)) return false;
+        return ptrace(PTRACE_POKEDATA, pid, target, trapped) == 0;
+    });
+    ptrace(PTRACE_POKEDATA, pid, target, original);
+
+    auto debugreg = [](int i) { return offsetof(user, u_debugreg) + i * sizeof(long); };
+    bool debugregs = ptrace(PTRACE_POKEUSER, pid, debugreg(0), target) == 0 && ptrace(PTRACE_POKEUSER, pid, debugreg(7), 1) == 0;
+    if (debugregs) {
+        measure("breakpoint hit, debug register", 0, [&] { // the CPU resumes past an execution breakpoint by itself
+            return ptrace(PTRACE_CONT, pid, nullptr, nullptr) == 0 && wait_stop(pid);
+        });
+        ptrace(PTRACE_POKEUSER, pid, debugreg(7), 0);
+    }
+    else {
+        cout<<left<<setw(36)<<"breakpoint hit, debug register"<<right<<setw(10)<<""<<"  failed: "<<strerror(errno)<<endl;
+    }
+
+    measure("stop, PTRACE_SINGLESTEP", 0, [&] {
+        return ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) == 0 && wait_stop(pid);
+    });
+    measure("stop, PTRACE_SINGLEBLOCK", 0, [&] { // the tracee's loop has a taken branch every few instructions
+        return ptrace(PTRACE_SINGLEBLOCK, pid, nullptr, nullptr) == 0 && wait_stop(pid);
+    });
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    close(mem);
+
+    cout<<endl<<"Fastest:"<<endl;
+    for (size_t size : {8, 64, 4096, 65536}) {
+        cout<<"- read of "<<size<<" bytes: "<<fastest({"read PTRACE_PEEKDATA", "read process_vm_readv", "read /proc/pid/mem"}, size)<<endl;
+    }
+    for (size_t size : {8, 4096}) {
+        cout<<"- write of "<<size<<" bytes: "<<fastest({"write PTRACE_POKEDATA", "write process_vm_writev", "write /proc/pid/mem"}, size)<<endl;
+    }
+    cout<<"- registers: "<<fastest({"registers PTRACE_GETREGS", "registers PTRACE_GETREGSET"}, 0)<<endl;
+    cout<<"- breakpoint hit: "<<fastest({"breakpoint hit, int3", "breakpoint hit, debug register"}, 0)<<endl;
+    cout<<"- stop: "<<fastest({"stop, PTRACE_SINGLESTEP", "stop, PTRACE_SINGLEBLOCK"}, 0)<<endl;
+
+    if (csv != "") {
+        std::ofstream out {csv};
+        out << "primitive,bytes,calls,ns_per_call" << endl;
+        for (const auto& r : results) out << r.name << "," << r.bytes << "," << r.calls << "," << r.nsPerCall << endl;
+        if (!out) cerr << "Cannot write " << csv << endl;
+    }
+    return 0;
+}
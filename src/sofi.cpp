@@ -1,7 +1,9 @@
 #include <vector>
+#include <unordered_set>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
 #include <sys/personality.h>
+#include <sys/auxv.h>
 #include <unistd.h>
 #include <sstream>
 #include <fstream>
@@ -15,6 +17,8 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 
 #include <cstdlib>
@@ -24,6 +28,7 @@
 #include <future>
 #include <thread>
 #include <chrono>
+#include <atomic>
 
 #include <mutex>              
 #include <condition_variable> 
@@ -35,46 +40,65 @@ using namespace std::chrono;
 
 #include "debugger.hpp"
 #include "registers.hpp"
+#include "output_capture.hpp"
+#include "hang_detector.hpp"
+#include "golden_stats.hpp"
+#include "sandbox.hpp"
+#include "run_directory.hpp"
+#include "mpsc_queue.hpp"
+#include "result_log.hpp"
+#include "site_stats.hpp"
+#include "trace_events.hpp"
+#include "metrics_server.hpp"
 
 using namespace sofi;
 using namespace std;
 
-#define INFINITY 10 // Allowed duration of runtime (in seconds). After 10 seconds, SOFI considers that we entered hault mode.  
-#define BUFFER_SIZE 4096 // Maximum amount of output.
+static constexpr uint64_t stall_seconds = 10; // Allowed duration of runtime (in seconds) without any progress. After 10 seconds of it, SOFI considers that we entered hault mode.
 
-std::mutex mtx;
-std::condition_variable cv;
-bool ready = false;
-
-class ptrace_expr_context : public dwarf::expr_context {
+class ptrace_expr_context : public dwarf::expr_context { // evaluates DWARF expressions at the current stop of a debugger
 public:
-    ptrace_expr_context (pid_t pid, uint64_t load_address) : 
-       m_pid{pid}, m_load_address(load_address) {}
+    ptrace_expr_context (debugger& dbg) : m_dbg{dbg} {}
 
     dwarf::taddr reg (unsigned regnum) override {
-        return get_register_value_from_dwarf_register(m_pid, regnum);
+        return get_register_value_from_dwarf_register(m_dbg.get_registers(), regnum);
     }
 
     dwarf::taddr pc() {
-        struct user_regs_struct regs;
-        ptrace(PTRACE_GETREGS, m_pid, nullptr, &regs);
-        return regs.rip - m_load_address;
+        return m_dbg.get_offset_pc();
+    }
+
+    dwarf::taddr relocate(dwarf::taddr address) { // DW_OP_addr pushes addresses of the file, below the load address of a PIE; those computed from registers are already absolute
+        return address < m_dbg.m_load_address ? m_dbg.offset_dwarf_address(address) : address;
     }
 
     dwarf::taddr deref_size (dwarf::taddr address, unsigned size) override {
-        //TODO take into account size
-        return ptrace(PTRACE_PEEKDATA, m_pid, address + m_load_address, nullptr);
+        dwarf::taddr value = 0; // little endian, so a short read leaves the upper bytes zeroed
+        if (size > sizeof(value) || !m_dbg.read_memory(relocate(address), &value, size)) {
+            throw dwarf::expr_error{"Cannot read debugee memory"};
+        }
+        return value;
     }
 
 private:
-    pid_t m_pid;
-    uint64_t m_load_address;
+    debugger& m_dbg;
 };
 template class std::initializer_list<dwarf::taddr>;
-void debugger::read_variables(uint64_t* variables, int&size) {
+uint64_t type_size(dwarf::die type) { // in bytes, through typedefs and qualifiers; 0 if unknown
+    for (int depth = 0; depth < 16; ++depth) {
+        if (type.has(dwarf::DW_AT::byte_size)) return dwarf::at_byte_size(type, nullptr);
+        if (!type.has(dwarf::DW_AT::type)) return 0;
+        type = dwarf::at_type(type);
+    }
+    return 0;
+}
+
+std::vector<uint64_t> debugger::read_variables(std::vector<uint64_t>* sizes) { // addresses of the variables and arguments that live in memory at the current pc
     using namespace dwarf;
 
+    std::vector<uint64_t> variables;
     auto func = get_function_from_pc(get_offset_pc());
+    ptrace_expr_context context {*this}; // shared by all variables, so registers and memory are read once per stop
 
     for (const auto& die : func) {
         if (die.tag == DW_TAG::variable || die.tag == DW_TAG::formal_parameter) {
@@ -82,26 +106,18 @@ void debugger::read_variables(uint64_t* variables, int&size) {
 
             //only supports exprlocs for now
             if (loc_val.get_type() == value::type::exprloc) {
-                ptrace_expr_context context {m_pid, m_load_address};
                 auto result = loc_val.as_exprloc().evaluate(&context);
 
                 switch (result.location_type) {
                 case expr_result::type::address:
                 {
-                    auto offset_addr = result.value;
-                    auto value = read_memory(offset_addr);
-                    variables[size] = offset_addr;
-                    size++;
+                    variables.push_back(context.relocate(result.value));
+                    if (sizes) sizes->push_back(die.has(DW_AT::type) ? type_size(at_type(die)) : 0);
                     break;
                 }
 
-                case expr_result::type::reg:
-                {
-                    auto value = get_register_value_from_dwarf_register(m_pid, result.value);
-                    variables[size] = result.value;
-                    size ++;
+                case expr_result::type::reg: // no memory to corrupt, the value is a register number
                     break;
-                }
 
                 default:
                     throw std::runtime_error{"Unhandled variable location"};
@@ -112,6 +128,8 @@ void debugger::read_variables(uint64_t* variables, int&size) {
             }
         }
     }
+
+    return variables;
 }
 
 symbol_type to_symbol_type(elf::stt sym) {
@@ -185,12 +203,29 @@ uint64_t debugger::read_memory(uint64_t address) {
     return ptrace(PTRACE_PEEKDATA, m_pid, address, nullptr);
 }
 
+bool debugger::read_memory(uint64_t address, void* buffer, std::size_t size) { // cached until the debugee resumes
+    return m_memory.read(address, buffer, size);
+}
+
 void debugger::write_memory(uint64_t address, uint64_t value) {
     ptrace(PTRACE_POKEDATA, m_pid, address, value);
+    m_memory.invalidate();
+}
+
+auto debugger::get_registers() -> user_regs_struct& { // fetched once per stop
+    if (!m_regs_valid) {
+        ptrace(PTRACE_GETREGS, m_pid, nullptr, &m_regs);
+        m_regs_valid = true;
+    }
+    return m_regs;
+}
+
+void debugger::set_registers() {
+    ptrace(PTRACE_SETREGS, m_pid, nullptr, &m_regs);
 }
 
 uint64_t debugger::get_pc() { // get program counter
-    return get_register_value(m_pid, reg::rip);
+    return get_registers().rip;
 }
 
 uint64_t debugger::get_offset_pc() {
@@ -198,7 +233,8 @@ uint64_t debugger::get_offset_pc() {
 }
 
 void debugger::set_pc(uint64_t pc) { // chnage program counter (used in handling breakpoints)
-    set_register_value(m_pid, reg::rip, pc);
+    get_registers().rip = pc;
+    set_registers();
 }
 
 dwarf::die debugger::get_function_from_pc(uint64_t pc) { // get function using program counter
@@ -293,7 +329,7 @@ void debugger::print_source(const std::string& file_name, unsigned line, unsigne
 }
 
 siginfo_t debugger::get_signal_info() {
-    siginfo_t info;
+    siginfo_t info{}; // stays zeroed if the debugee has already exited
     ptrace(PTRACE_GETSIGINFO, m_pid, nullptr, &info);
     return info;
 }
@@ -302,19 +338,45 @@ void debugger::single_step() {
     ptrace(PTRACE_SINGLESTEP, m_pid, nullptr, nullptr);
 }
 
-void debugger::step_over_breakpoint() {
-    if (m_breakpoints.count(get_pc())) {
-        auto& bp = m_breakpoints[get_pc()];
-        if (bp.is_enabled()) {
-            bp.disable();
+void debugger::step_over_breakpoint() { // executes the original instruction and re-arms the breakpoint
+    auto it = m_breakpoints.find(get_pc());
+    if (it != m_breakpoints.end() && it->second.is_enabled()) {
+        auto& bp = it->second;
+        bp.disable();
+        single_step_instruction();
+        while (WIFSTOPPED(m_wait_status) && WSTOPSIG(m_wait_status) != SIGTRAP) { // e.g. SIGCHLD stopped it before the instruction ran
+            ptrace(PTRACE_SINGLESTEP, m_pid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(pending_signal())));
+            wait_for_signal();
+        }
+        if (WIFSTOPPED(m_wait_status)) {
+            bp.enable();
         }
     }
 }
 
-siginfo_t debugger::wait_for_signal() {
+bool debugger::wait_for_status() { // waits for the next stop or the end of the debugee, false if there is nothing left to wait for
     int wait_status;
-    // auto options = ;
-    waitpid(m_pid, &wait_status, WSTOPPED | WUNTRACED);//WUNTRACED
+    rusage usage;
+    if (auto counters = current_counters()) counters->waits.fetch_add(1, std::memory_order_relaxed);
+    while (wait4(m_pid, &wait_status, WSTOPPED | WUNTRACED, &usage) == -1) {//WUNTRACED
+        if (errno != EINTR) return false;
+    }
+    m_wait_status = wait_status;
+    m_regs_valid = false;
+    m_memory.invalidate();
+    if (!WIFSTOPPED(wait_status)) { // resources are only reported for a reaped debugee
+        user_time = usage.ru_utime.tv_sec * 1000000ull + usage.ru_utime.tv_usec;
+        system_time = usage.ru_stime.tv_sec * 1000000ull + usage.ru_stime.tv_usec;
+        cpu_time = user_time + system_time;
+        max_rss = usage.ru_maxrss;
+        minor_faults = usage.ru_minflt;
+        major_faults = usage.ru_majflt;
+    }
+    return true;
+}
+
+siginfo_t debugger::wait_for_signal() {
+    wait_for_status();
     // cout<<"########### "<<m_pid<<endl;
     auto siginfo = get_signal_info();
     switch (siginfo.si_signo) {
@@ -337,11 +399,12 @@ void debugger::handle_sigtrap(siginfo_t info) {
     {
         set_pc(get_pc()-1);
         // std::cout << "Hit breakpoint at address 0x" << std::hex << get_pc() << std::endl;
-        auto offset_pc = offset_load_address(get_pc()); //rember to offset the pc for querying DWARF
-        auto line_entry = get_line_entry_from_pc(offset_pc);
-        // print_source(line_entry->file->path, line_entry->line);
+        // print_source(get_line_entry_from_pc(get_offset_pc())->file->path, get_line_entry_from_pc(get_offset_pc())->line);
         return;
     }
+    //this will be set if a watchpoint was hit, the pc is already past the access
+    case TRAP_HWBKPT:
+        return;
     //this will be set if the signal was sent by single stepping
     // case TRAP_TRACE:
     //     return;
@@ -354,16 +417,35 @@ void debugger::handle_sigtrap(siginfo_t info) {
     }
 }
 
-void debugger::continue_execution() {
+void debugger::continue_execution(int sig) { // 'sig' is delivered to the debugee as it resumes
     step_over_breakpoint();
-    ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
+    ptrace(PTRACE_CONT, m_pid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(sig)));
     wait_for_signal();
 }
 
+int debugger::pending_signal() { // signal the debugee stopped on that it should still receive, 0 if there is none
+    if (!WIFSTOPPED(m_wait_status)) return 0;
+    int sig = WSTOPSIG(m_wait_status);
+    switch (sig) {
+    case SIGTRAP: // ours: breakpoints, watchpoints and steps
+    case SIGSTOP: // stop signals would leave the debugee stopped for good
+    case SIGTSTP:
+    case SIGTTIN:
+    case SIGTTOU:
+        return 0;
+    default:
+        return sig;
+    }
+}
+
 void debugger::continue_execution_single_step() {
-    step_over_breakpoint();
-    single_step();
-    wait_for_signal();
+    if (m_breakpoints.count(get_pc())) {
+        step_over_breakpoint();
+    }
+    else {
+        single_step();
+        wait_for_signal();
+    }
 }
 
 void debugger::dump_registers() { // print out all registers (used for testing purposes)
@@ -446,19 +528,23 @@ void debugger::set_breakpoint_at_source_line(const std::string& file, unsigned l
     }
 }
 
-void debugger::get_alligned_address(std::intptr_t& addr) { // gets the useful address to set the mutation target
+void debugger::get_alligned_address(std::intptr_t& addr, std::intptr_t low, std::intptr_t high) {
+/*
+Gets the useful address to set the mutation target: the first statement at or after 'addr' within [low, high], else the last one before it.
+Line tables aren't sorted across sequences and units (e.g. COMDAT functions of a header), so every row is considered.
+*/
+    intptr_t after = INTPTR_MAX, before = -1;
     for (const auto& cu : m_dwarf.compilation_units()) {
-        
-        const auto& lt = cu.get_line_table();
-
-        for (const auto& entry : lt) {
-            if (entry.is_stmt && offset_dwarf_address(entry.address)>=addr) {
-                addr = offset_dwarf_address(entry.address);
-                return;
-            }
+        for (const auto& entry : cu.get_line_table()) {
+            if (!entry.is_stmt || entry.end_sequence) continue;
+            intptr_t a = offset_dwarf_address(entry.address);
+            if (a < low || a > high) continue;
+            if (a >= addr) after = std::min(after, a);
+            else before = std::max(before, a);
         }
-        
     }
+    if (after != INTPTR_MAX) addr = after;
+    else if (before >= 0) addr = before;
 }
 
 void debugger::get_address_at_source_line(const std::string& file, unsigned line, intptr_t& addr) { // gets address using the line of code
@@ -476,54 +562,649 @@ void debugger::get_address_at_source_line(const std::string& file, unsigned line
     }
 }
 
-void debugger::set_breakpoint_at_address(std::intptr_t addr) { // sets breakpoint at a certain address
+void debugger::set_breakpoint_at_address(std::intptr_t addr, unsigned target_hits) { // sets breakpoint at a certain address
     // std::cout << "Set breakpoint at address 0x" << std::hex << addr << std::endl;
-    breakpoint bp {m_pid, addr};
+    auto it = m_breakpoints.find(addr);
+    if (it != m_breakpoints.end()) { // enabling it twice would save the int3 as the original byte
+        it->second.set_target_hits(target_hits);
+        return;
+    }
+    breakpoint bp {m_pid, addr, target_hits};
     bp.enable();
     m_breakpoints[addr] = bp;
 }
 
+void debugger::remove_breakpoint(std::intptr_t addr) {
+    auto it = m_breakpoints.find(addr);
+    if (it == m_breakpoints.end()) return;
+    if (it->second.is_enabled()) {
+        it->second.disable();
+    }
+    m_breakpoints.erase(it);
+}
+
+bool debugger::run_to_breakpoint(std::intptr_t addr, unsigned hit) {
+/*
+Runs until the instruction at 'addr' is about to be executed for the 'hit'-th time, and removes the breakpoint.
+Earlier hits are only counted, so they have to be cheap. With a free debug register, the CPU resumes past an
+execution breakpoint by itself: a hit costs one stop and one PTRACE_CONT, about a third less than an int3, which has to be
+stepped over and re-armed (see ptrace_bench). The int3 is only used when every debug register is taken.
+Signals for the debugee are delivered on the way. Returns false if the debugee exited or stopped for another reason first.
+*/
+    enter(phase::breakpoint_arming);
+    if (m_watchpoints.size() < n_watchpoints) {
+        auto slot = set_watchpoint_at_address(addr, watch_condition::execute, 1);
+        enter(phase::run_to_trigger);
+        int sig = 0;
+        for (unsigned hits = 0; hits < hit; ) {
+            ptrace(PTRACE_CONT, m_pid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(sig)));
+            wait_for_status();
+            if (!WIFSTOPPED(m_wait_status)) return false;
+            sig = pending_signal(); // e.g. SIGCHLD, delivered as it resumes; a fatal one ends the run on the next stop
+            if (WSTOPSIG(m_wait_status) == SIGTRAP && m_watchpoints[slot].is_hit()) { // DR6 says it's this slot, not another trap
+                m_watchpoints[slot].clear_status();
+                ++hits;
+            }
+        }
+        remove_watchpoint(slot);
+        return get_pc() == static_cast<uint64_t>(addr);
+    }
+
+    set_breakpoint_at_address(addr, hit);
+    enter(phase::run_to_trigger);
+    int sig = 0;
+    while (true) {
+        continue_execution(sig);
+        if (!WIFSTOPPED(m_wait_status)) return false;
+        sig = pending_signal();
+        if (sig) continue;
+        if (get_pc() != static_cast<uint64_t>(addr)) {
+            remove_breakpoint(addr);
+            return false;
+        }
+        if (m_breakpoints[addr].hit()) break;
+    }
+    remove_breakpoint(addr);
+    return true;
+}
+
+unsigned debugger::set_watchpoint_at_address(std::intptr_t addr, watch_condition cond, unsigned len) { // arms a free debug register on addr
+    for (unsigned slot = 0; slot < n_watchpoints; ++slot) {
+        if (!m_watchpoints.count(slot)) {
+            watchpoint wp {m_pid, addr, slot, cond, len};
+            wp.enable();
+            m_watchpoints[slot] = wp;
+            return slot;
+        }
+    }
+
+    throw std::out_of_range{"No free debug register"};
+}
+
+void debugger::remove_watchpoint(unsigned slot) {
+    auto& wp = m_watchpoints.at(slot);
+    wp.disable();
+    wp.clear_status();
+    m_watchpoints.erase(slot);
+}
+
 void debugger::run() { //used to initialize the debugger
     wait_for_signal();
     initialise_load_address();
 }
 
+void debugger::enter(phase p) { // the run is in phase 'p' from now on
+    if (clock) clock->enter(p);
+}
+
+void debugger::seed(uint64_t campaign_seed, long tid) { // the same seed and tid make the same choices, whichever worker makes the run
+    std::seed_seq seq {static_cast<uint32_t>(campaign_seed), static_cast<uint32_t>(campaign_seed >> 32), static_cast<uint32_t>(tid)};
+    m_rng.seed(seq);
+}
+
+int debugger::random() { // drop-in for rand()
+    return m_rng() & RAND_MAX;
+}
+
+void debugger::trace_blocks(block_trace& trace) {
+/*
+Runs the debugee to its end, recording every basic block of the program image it executes.
+PTRACE_SINGLEBLOCK only stops on taken branches. Calls into shared libraries are run at full speed up to their return address,
+and the start-up code before main isn't traced. The return address is taken where the call left the program: at its first PLT stub,
+as lazy binding pushes more onto the stack before the dynamic linker runs. Main has returned when its own return address is reached. Hypervisors that don't virtualise branch stepping silently single step instead;
+when most stops are only a few bytes apart we switch to one breakpoint per statement, which is cheaper than that.
+*/
+    uint64_t image_start = UINT64_MAX, image_end = 0;
+    for (const auto& seg : m_elf.segments()) {
+        const auto& hdr = seg.get_hdr();
+        if (hdr.type == elf::pt::load && (hdr.flags & elf::pf::x) == elf::pf::x) {
+            image_start = std::min(image_start, offset_dwarf_address(hdr.vaddr));
+            image_end = std::max(image_end, offset_dwarf_address(hdr.vaddr + hdr.memsz));
+        }
+    }
+    auto in_image = [&](uint64_t addr) { return addr >= image_start && addr < image_end; };
+    std::vector<std::pair<uint64_t, uint64_t>> plt; // .plt, .plt.sec and .plt.got
+    for (const auto& sec : m_elf.sections()) {
+        const auto& hdr = sec.get_hdr();
+        if (sec.get_name() == ".plt" || sec.get_name() == ".plt.sec" || sec.get_name() == ".plt.got") {
+            plt.push_back({offset_dwarf_address(hdr.addr), offset_dwarf_address(hdr.addr + hdr.size)});
+        }
+    }
+    auto in_plt = [&](uint64_t addr) {
+        return std::any_of(plt.begin(), plt.end(), [addr](const std::pair<uint64_t, uint64_t>& r) { return addr >= r.first && addr < r.second; });
+    };
+
+    auto main_syms = lookup_symbol("main");
+    if (main_syms.empty() || !run_to_breakpoint(offset_dwarf_address(main_syms[0].addr), 1)) return;
+    enter(phase::post_fault_run); // the rest of the run, as for any other golden run
+    trace.record(get_offset_pc());
+    auto main_ret = read_memory(get_registers().rsp); // in the C library's start-up code
+
+    uint64_t prev = get_pc(), stops = 0, sequential = 0;
+    uint64_t call_rsp = 0; // at the first PLT stub of the call in progress, where its return address is
+    int sig = 0;
+    while (true) {
+        if (ptrace(PTRACE_SINGLEBLOCK, m_pid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(sig))) < 0) {
+            trace_statements(trace);
+            return;
+        }
+        wait_for_signal();
+        if (!WIFSTOPPED(m_wait_status)) return;
+        sig = pending_signal();
+        if (sig || WSTOPSIG(m_wait_status) != SIGTRAP) continue;
+
+        auto pc = get_pc();
+        if (in_image(pc)) {
+            if (!in_plt(pc)) call_rsp = 0;
+            else if (!call_rsp) call_rsp = get_registers().rsp;
+            trace.record(offset_load_address(pc));
+            ++stops;
+            if (pc > prev && pc - prev <= 15) ++sequential;
+            prev = pc;
+            if (stops == 4096 && sequential * 10 > stops * 9) {
+                trace_statements(trace);
+                return;
+            }
+            continue;
+        }
+
+        auto rsp = call_rsp ? call_rsp : get_registers().rsp; // else called without a stub, we are at the first block of the callee
+        call_rsp = 0;
+        auto ret = pc == main_ret ? main_ret : read_memory(rsp);
+        if (ret == main_ret) { // main returned (or tail called a library), only exit code is left
+            ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
+            wait_for_signal();
+            return;
+        }
+        if (!in_image(ret)) continue; // not a call we know the return address of: stepped through
+
+        set_breakpoint_at_address(ret);
+        do {
+            continue_execution();
+            if (!WIFSTOPPED(m_wait_status)) return;
+        } while (get_pc() != ret || get_registers().rsp <= rsp); // a deeper frame of a recursive call
+        remove_breakpoint(ret);
+        trace.record(offset_load_address(ret));
+        prev = ret;
+    }
+}
+
+void debugger::trace_statements(block_trace& trace) { // fallback of trace_blocks, every statement is treated as a block
+    for (const auto& cu : m_dwarf.compilation_units()) {
+        for (const auto& entry : cu.get_line_table()) {
+            if (entry.is_stmt && !entry.end_sequence && offset_dwarf_address(entry.address) != get_pc()) {
+                set_breakpoint_at_address(offset_dwarf_address(entry.address));
+            }
+        }
+    }
+
+    int sig = 0;
+    while (true) {
+        step_over_breakpoint();
+        if (!WIFSTOPPED(m_wait_status)) break;
+        ptrace(PTRACE_CONT, m_pid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(sig)));
+        wait_for_signal();
+        if (!WIFSTOPPED(m_wait_status)) break;
+        sig = pending_signal();
+        if (WSTOPSIG(m_wait_status) == SIGTRAP && m_breakpoints.count(get_pc())) {
+            trace.record(get_offset_pc());
+        }
+    }
+    m_breakpoints.clear();
+}
+
+bool debugger::pick_executed_address(const block_trace& trace, std::intptr_t addr1, std::intptr_t addr2, std::intptr_t& addr, unsigned& hit) {
+/*
+Picks one of the blocks between addr1 and addr2 that the golden run executed, so that no injection is wasted on dead code.
+A 'hit' of 0 is replaced by a random execution of that block.
+*/
+    std::vector<const block_trace::block*> sites;
+    for (const auto& b : trace.blocks()) {
+        auto mapped = static_cast<std::intptr_t>(offset_dwarf_address(b.addr));
+        if (mapped >= addr1 && mapped <= addr2) sites.push_back(&b);
+    }
+    if (sites.empty()) return false;
+
+    auto site = sites[random() % sites.size()];
+    addr = offset_dwarf_address(site->addr);
+    if (hit == 0) {
+        hit = 1 + random() % site->count;
+    }
+    return true;
+}
+
 void debugger::mutate_opcode(std::intptr_t addr) { //opcode is changed at a random address
-    int randomOpcode = rand() % 0xFF;   
+    int randomOpcode = random() % 0xFF;   
     write_memory(addr, (read_memory(addr) & ~0xFF)|randomOpcode);
 }
 
-void debugger::mutate_register(std::intptr_t addr) {
+void debugger::mutate_register(std::intptr_t addr, unsigned hit) {
     /*
 This function is runned at the start of the program.
 First, we have a random address 'addr', we set a breakpoint on that address, and we continue our execution normally.
-When the breakpoint is hit we pick a random regiter to mutate.
+When the breakpoint is hit for the 'hit'-th time we pick a random regiter to mutate.
 */
-    set_breakpoint_at_address(addr);
-    continue_execution();
-    int randomRegister = rand() % 27 ;
-    int randomValue = rand();
+    if (run_to_breakpoint(addr, hit)) {
+        enter(phase::fault_apply);
+        corrupt_register();
+    }
+}
+
+void debugger::corrupt_register() { // overwrites a random register with a random value
+    int randomRegister = random() % 27 ;
+    int randomValue = random();
     set_register_value(m_pid, get_register_from_name(g_register_descriptors[randomRegister].name), randomValue);
+    m_regs_valid = false;
 }
 
-void debugger::mutate_data(std::intptr_t addr){ // mutates data
+void debugger::corrupt_memory(std::intptr_t addr) { // adds a small random offset to the word at addr
+    write_memory(addr, (read_memory(addr) +(random()%10 +1)));
+}
+
+void debugger::mutate_data(std::intptr_t addr, unsigned hit){ // mutates data
 /*
 This function is runned at the start of the program.
 First, we have a random address 'addr', we set a breakpoint on that address, and we continue our execution normally.
-When the breakpoint is hit, we get the available variables (locally defined variables and arguments), and pick a random one to mutate.
+When the breakpoint is hit for the 'hit'-th time, we get the available variables (locally defined variables and arguments), and pick a random one to mutate.
 */
 
-    set_breakpoint_at_address(addr);
-    continue_execution();
-    int size = 0;
-    uint64_t* variables = new uint64_t[100];
-    read_variables(variables, size);
-    int i = rand() % size;
-    // write_memory(variables[i], (((~0x1)&(read_memory(variables[i]))) | ~((0x1)&(read_memory(variables[i]))) ));
-    write_memory(variables[i], (read_memory(variables[i]) +(rand()%10 +1)));
+    if (!run_to_breakpoint(addr, hit)) return;
+    enter(phase::fault_apply);
+    auto variables = read_variables();
+    if (!variables.empty()) {
+        int i = random() % variables.size();
+        // write_memory(variables[i], (((~0x1)&(read_memory(variables[i]))) | ~((0x1)&(read_memory(variables[i]))) ));
+        corrupt_memory(variables[i]);
+    }
 }
 
-void execute_debugee (const std::string& prog_name) { // used to start tracing the debugee
+bool debugger::run_to_instruction(uint64_t count) {
+/*
+Runs until the debugee has retired 'count' user mode instructions, without breakpoints or single stepping.
+The counter overflow sends SIGIO to the debugee, which makes it stop; the signal is never delivered.
+The PMU stops the debugee a few instructions late (skid), which doesn't matter for a uniformly chosen count.
+Returns false if the debugee exited or stopped for another reason first.
+*/
+    enter(phase::breakpoint_arming);
+    perf_counter counter;
+    if (count == 0 || !counter.open(m_pid, count) || !counter.arm_overflow(m_pid, SIGIO)) {
+        return false;
+    }
+    enter(phase::run_to_trigger);
+    int sig = 0;
+    while (true) {
+        continue_execution(sig);
+        if (!WIFSTOPPED(m_wait_status)) return false;
+
+        auto info = get_signal_info();
+        if (info.si_signo == SIGIO && info.si_fd == counter.get_fd()) return true;
+        sig = pending_signal();
+        if (!sig) return false;
+    }
+}
+
+bool debugger::run_to_data_access(std::intptr_t addr, std::intptr_t& watch_addr, watch_condition cond, int skip) {
+/*
+Arms a hardware watchpoint and runs until the (skip+1)-th matching access, without single stepping.
+If no 'watch_addr' was chosen, we first stop at the random address 'addr' and watch one of the variables visible there.
+Debug registers trap after the access has completed, so a write is corrupted before its first use and a read before any later use.
+Returns false if the debugee exited before the access happened.
+*/
+    uint64_t size = 1; // of the variable, unknown for a 'watch_addr' given by the user: then only its first byte is watched
+    if (watch_addr == 0) {
+        if (!run_to_breakpoint(addr, 1)) return false;
+
+        std::vector<uint64_t> sizes;
+        auto variables = read_variables(&sizes);
+        if (variables.empty()) return false;
+        auto i = random() % variables.size();
+        watch_addr = variables[i];
+        size = std::max<uint64_t>(sizes[i], 1);
+    }
+
+    unsigned len = 8; // the longest watch of 1, 2, 4 or 8 bytes that is aligned and within the variable, e.g. all of an int
+    while (len > size || watch_addr % len) len /= 2;
+    enter(phase::breakpoint_arming);
+    auto slot = set_watchpoint_at_address(watch_addr, cond, len);
+    enter(phase::run_to_trigger);
+    int hits = 0, sig = 0;
+    while (true) {
+        continue_execution(sig);
+        if (!WIFSTOPPED(m_wait_status)) return false;
+
+        sig = pending_signal();
+        if (sig) continue;
+        auto info = get_signal_info();
+        if (info.si_signo != SIGTRAP || info.si_code != TRAP_HWBKPT || !m_watchpoints[slot].is_hit()) {
+            return false; // the debugee stopped for another reason, let the caller deliver the outcome
+        }
+        m_watchpoints[slot].clear_status();
+        if (hits++ == skip) break;
+    }
+
+    remove_watchpoint(slot);
+    return true;
+}
+
+bool soft_dirty_supported() {
+/*
+Tried once on a page of a child, not of SOFI itself, whose soft-dirty bits clear_refs would reset: kernels may accept clear_refs
+without tracking soft-dirty pages. The page must be clean right after clear_refs, and soft-dirty again once written.
+*/
+    static const bool supported = [] {
+        const long page = sysconf(_SC_PAGESIZE);
+        auto p = static_cast<volatile char*>(mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (p == MAP_FAILED) return false;
+        int go[2], done[2];
+        if (pipe2(go, O_CLOEXEC) == -1) return false;
+        if (pipe2(done, O_CLOEXEC) == -1) {
+            close(go[0]);
+            close(go[1]);
+            return false;
+        }
+        pid_t child = fork();
+        if (child == 0) { // writes the page, then again each time it's told to, until its end of the pipe is closed
+            close(go[1]);
+            close(done[0]);
+            char c = 0;
+            do {
+                p[0] = c;
+                if (write(done[1], &c, 1) != 1) break;
+            } while (read(go[0], &c, 1) == 1);
+            _exit(0);
+        }
+        close(go[0]);
+        close(done[1]);
+        auto soft_dirty = [&]() -> int { // of the child's page, -1 if unknown
+            uint64_t entry = 0;
+            int pagemap = open(("/proc/" + std::to_string(child) + "/pagemap").c_str(), O_RDONLY | O_CLOEXEC);
+            if (pagemap < 0) return -1;
+            auto n = pread(pagemap, &entry, sizeof(entry), reinterpret_cast<uint64_t>(p) / page * sizeof(entry));
+            close(pagemap);
+            return n == sizeof(entry) ? (entry >> 55) & 1 : -1;
+        };
+        char c = 1;
+        bool ok = child > 0 && read(done[0], &c, 1) == 1;
+        if (ok) {
+            std::ofstream {"/proc/" + std::to_string(child) + "/clear_refs"} << "4";
+            ok = soft_dirty() == 0 && write(go[1], &c, 1) == 1 && read(done[0], &c, 1) == 1 && soft_dirty() == 1;
+        }
+        close(go[1]);
+        close(done[0]);
+        if (child > 0) waitpid(child, nullptr, 0);
+        munmap(const_cast<char*>(p), page);
+        return ok;
+    }();
+    return supported;
+}
+
+bool debugger::run_to_function_exit(const std::vector<std::intptr_t>& functions) {
+/*
+Runs until one of 'functions' returns, with a breakpoint on their entry and one on the return address of every call in progress.
+A call has returned once the pc is on its return address with the stack pointer just above the one it was called with,
+so recursive calls aren't mistaken for each other. Calls left with longjmp or an exception are dropped when the stack unwinds past them.
+Signals for the debugee are delivered on the way. Returns false once the debugee has terminated.
+*/
+    for (auto f : functions) {
+        set_breakpoint_at_address(f, 0);
+    }
+    int sig = 0;
+    while (true) {
+        continue_execution(sig);
+        if (!WIFSTOPPED(m_wait_status)) return false;
+        sig = pending_signal();
+        if (sig || WSTOPSIG(m_wait_status) != SIGTRAP) continue;
+
+        auto pc = get_pc();
+        auto sp = get_registers().rsp;
+        bool returned = false;
+        while (!m_returns.empty() && m_returns.back().second < sp) {
+            auto call = m_returns.back();
+            m_returns.pop_back();
+            returned = call.first == pc && call.second + sizeof(uint64_t) == sp;
+            bool pending = std::any_of(m_returns.begin(), m_returns.end(), [&](const std::pair<uint64_t, uint64_t>& c) { return c.first == call.first; });
+            if (!pending && std::find(functions.begin(), functions.end(), static_cast<std::intptr_t>(call.first)) == functions.end()) {
+                remove_breakpoint(call.first);
+            }
+        }
+        if (std::find(functions.begin(), functions.end(), static_cast<std::intptr_t>(pc)) != functions.end()) { // a call, sp is on its return address
+            auto ret = read_memory(sp);
+            m_returns.push_back({ret, sp});
+            set_breakpoint_at_address(ret, 0);
+        }
+        if (returned) return true;
+    }
+}
+
+uint64_t hash_item(uint64_t key, char* data, std::size_t size, const state_mask& mask) { // zeroes the item's masked words first
+    auto it = mask.words.find(key);
+    if (it != mask.words.end()) {
+        for (auto offset : it->second) std::memset(data + offset, 0, sizeof(uint64_t));
+    }
+    return fnv1a(data, size);
+}
+
+auto debugger::read_state(const state_mask& mask, item_contents* contents) -> state_items {
+/*
+Fingerprints of everything the rest of the run depends on in the debugee, item by item: each register, keyed by its index,
+the floating point registers (key n_registers), and each page, keyed by its address, of the code of the program
+(with the original bytes under our breakpoints) and of the private memory it wrote to, shared libraries' included.
+Pages it never wrote to are the same in every run: those that aren't soft-dirty since clear_dirty_pages() are skipped,
+and on kernels without soft-dirty tracking, those still backed by a file. Kernel state (file offsets, pending signals...) isn't part of it.
+What differs from one golden run to the next (allocator keys, timestamps, the pid...) is found by comparing two of them, see volatile_items():
+the words of it in 'mask' are zeroed before hashing. The golden runs keep the bytes they hashed in 'contents', for that comparison.
+*/
+    state_items items;
+    auto add = [&](uint64_t key, char* data, std::size_t size) {
+        if (contents) {
+            auto hash = fnv1a(data, size);
+            contents->emplace(hash, std::string(data, size)); // pages that didn't change since the last point are kept once
+            items.push_back({key, hash});
+        }
+        else {
+            items.push_back({key, hash_item(key, data, size, mask)});
+        }
+    };
+    auto& regs = get_registers();
+    for (std::size_t i = 0; i < n_registers; ++i) {
+        items.push_back({i, *(reinterpret_cast<const uint64_t*>(&regs) + i)});
+    }
+    user_fpregs_struct fpregs;
+    if (ptrace(PTRACE_GETFPREGS, m_pid, nullptr, &fpregs) == 0) {
+        add(n_registers, reinterpret_cast<char*>(&fpregs), sizeof(fpregs));
+    }
+
+    const uint64_t page = sysconf(_SC_PAGESIZE);
+    const std::string proc = "/proc/" + std::to_string(m_pid);
+    int mem = open((proc + "/mem").c_str(), O_RDONLY | O_CLOEXEC);
+    int pagemap = open((proc + "/pagemap").c_str(), O_RDONLY | O_CLOEXEC);
+    bool soft_dirty = soft_dirty_supported();
+    std::vector<uint64_t> entries;
+    std::vector<char> buffer;
+    auto hash_range = [&](uint64_t start, uint64_t end) { // one item per page
+        buffer.resize(end - start);
+        iovec local {buffer.data(), buffer.size()}, remote {reinterpret_cast<void*>(start), buffer.size()};
+        if (process_vm_readv(m_pid, &local, 1, &remote, 1, 0) != static_cast<ssize_t>(buffer.size()) // twice as fast on large ranges
+            && pread(mem, buffer.data(), buffer.size(), start) != static_cast<ssize_t>(buffer.size())) return; // e.g. pages it can't read
+        count_transfer(buffer.size(), 0);
+        for (const auto& bp : m_breakpoints) {
+            uint64_t a = bp.first;
+            if (bp.second.is_enabled() && a >= start && a < end) buffer[a - start] = bp.second.get_saved_data();
+        }
+        for (uint64_t p = start; p < end; p += page) {
+            add(p, buffer.data() + (p - start), page);
+        }
+    };
+
+    std::ifstream maps {proc + "/maps"};
+    std::string line;
+    while (std::getline(maps, line)) {
+        uint64_t start, end;
+        char perms[5] = {};
+        if (sscanf(line.c_str(), "%lx-%lx %4s", &start, &end, perms) != 3) continue;
+        auto name = line.find_first_of("/[") == std::string::npos ? "" : line.substr(line.find_first_of("/["));
+        if (name == "[vvar]" || name == "[vvar_vclock]" || name == "[vdso]" || name == "[vsyscall]") continue; // the kernel's
+        if (perms[1] != 'w') {
+            if (name == m_prog_name) hash_range(start, end); // where opcodes are mutated
+            continue;
+        }
+
+        auto pages = (end - start) / page;
+        entries.resize(pages);
+        auto size = static_cast<ssize_t>(pages * sizeof(uint64_t));
+        if (pagemap < 0 || pread(pagemap, entries.data(), size, start / page * sizeof(uint64_t)) != size) {
+            hash_range(start, end); // every page then
+            continue;
+        }
+        auto written = [&](uint64_t e) {
+            bool present = e & (3ull << 62); // in memory or swapped out
+            return present && (soft_dirty ? (e >> 55) & 1 : !((e >> 61) & 1));
+        };
+        for (uint64_t i = 0; i < pages; ) { // runs of written pages, read at once
+            if (!written(entries[i])) {
+                ++i;
+                continue;
+            }
+            auto j = i;
+            while (j < pages && written(entries[j])) ++j;
+            hash_range(start + i * page, start + j * page);
+            i = j;
+        }
+    }
+    if (pagemap >= 0) close(pagemap);
+    if (mem >= 0) close(mem);
+    return items; // sorted as the maps are
+}
+
+uint64_t hash_state(const state_items& items, const std::unordered_set<uint64_t>& mask) { // one hash of the items, but those in 'mask'
+    uint64_t hash = fnv1a(nullptr, 0);
+    for (const auto& item : items) {
+        if (mask.count(item.first)) continue;
+        hash = fnv1a(reinterpret_cast<const char*>(&item), sizeof(item), hash);
+    }
+    return hash;
+}
+
+void volatile_items(const golden_points& a, const golden_points& b, std::size_t k, state_mask& mask) {
+/*
+Adds to 'mask' what differs between the k-th states of two golden runs: the words that differ in pages and floating point registers
+both have, other items whole. An item only one of them has, e.g. a page the other didn't write to, isn't masked:
+a faulty run then has to match the state of the run that has it, or that of the other.
+*/
+    auto i = a.states[k].begin(), j = b.states[k].begin();
+    auto a_end = a.states[k].end(), b_end = b.states[k].end();
+    while (i != a_end && j != b_end) { // both are sorted by key
+        if (i->first < j->first) ++i;
+        else if (j->first < i->first) ++j;
+        else {
+            if (i->second != j->second) {
+                auto x = a.contents.find(i->second), y = b.contents.find(j->second);
+                if (x == a.contents.end() || y == b.contents.end() || x->second.size() != y->second.size()) mask.items.insert(i->first);
+                else {
+                    auto& words = mask.words[i->first];
+                    for (std::size_t o = 0; o + sizeof(uint64_t) <= x->second.size(); o += sizeof(uint64_t)) {
+                        if (std::memcmp(&x->second[o], &y->second[o], sizeof(uint64_t))) words.push_back(o);
+                    }
+                }
+            }
+            ++i;
+            ++j;
+        }
+    }
+}
+
+uint64_t golden_state(const golden_points& run, std::size_t k, const state_mask& mask) { // hash of the k-th state of a golden run, once masked
+    auto items = run.states[k];
+    for (auto& item : items) {
+        auto content = run.contents.find(item.second);
+        if (content == run.contents.end() || !mask.words.count(item.first)) continue;
+        auto data = content->second;
+        item.second = hash_item(item.first, &data[0], data.size(), mask);
+    }
+    return hash_state(items, mask.items);
+}
+
+void debugger::fix_random_bytes() { // the 16 bytes of AT_RANDOM, from which the C library derives its stack canary and pointer guard
+    std::ifstream auxv {"/proc/" + std::to_string(m_pid) + "/auxv", std::ios::binary};
+    uint64_t entry[2];
+    while (auxv.read(reinterpret_cast<char*>(entry), sizeof(entry)) && entry[0] != AT_NULL) {
+        if (entry[0] == AT_RANDOM) {
+            write_memory(entry[1], 0x736f66692d636b31ull); // still unused at the exec stop
+            write_memory(entry[1] + 8, 0x736f66692d636b32ull);
+            return;
+        }
+    }
+}
+
+void debugger::clear_dirty_pages() { // pages written from now on are soft-dirty again
+    std::ofstream clear_refs {"/proc/" + std::to_string(m_pid) + "/clear_refs"};
+    clear_refs << "4";
+}
+
+void debugger::run_to_exit() {
+/*
+Resumes the debugee until it terminates, and classifies how it did. Signals meant for the debugee are delivered to it.
+SIGTRAPs are ours (breakpoints and watchpoints left behind), and stop signals would leave it stopped for good: those are swallowed.
+The siginfo of the last delivered signal is kept in 'result', so that a fatal one can still be reported once the process is gone.
+*/
+    while (WIFSTOPPED(m_wait_status)) {
+        int sig = pending_signal();
+        if (sig) {
+            result = get_signal_info();
+        }
+        else if (WSTOPSIG(m_wait_status) == SIGTRAP) {
+            auto it = m_breakpoints.find(get_pc());
+            if (it != m_breakpoints.end() && it->second.is_enabled()) {
+                step_over_breakpoint();
+                continue; // the step may have stopped on a signal of its own
+            }
+        }
+        ptrace(PTRACE_CONT, m_pid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(sig)));
+        wait_for_signal();
+    }
+
+    if (WIFEXITED(m_wait_status)) {
+        exit_code = WEXITSTATUS(m_wait_status);
+        outcome = exit_code == 0 ? run_outcome::exited : run_outcome::exit_code;
+        result = siginfo_t{}; // signals it survived don't matter
+    }
+    else if (WIFSIGNALED(m_wait_status)) {
+        outcome = run_outcome::fatal_signal;
+        if (result.si_signo != WTERMSIG(m_wait_status)) { // SIGKILL, or a signal that never stopped it
+            result = siginfo_t{};
+            result.si_signo = WTERMSIG(m_wait_status);
+        }
+    }
+}
+
+void debugger::kill_and_reap() { // leaves neither a stopped debugee nor a zombie behind
+    if (WIFEXITED(m_wait_status) || WIFSIGNALED(m_wait_status)) return; // already reaped
+    kill(m_pid, SIGKILL);
+    while (wait_for_status() && WIFSTOPPED(m_wait_status)) {}
+}
+
+void execute_debugee (const std::string& prog_name, const sandbox_profile& sandbox) { // used to start tracing the debugee
+    apply_limits(sandbox);
     if (ptrace(PTRACE_TRACEME, 0, 0, 0) < 0) {
         std::cerr << "Error in ptrace\n";
         return;
@@ -532,6 +1213,11 @@ void execute_debugee (const std::string& prog_name) { // used to start tracing t
 }
 
 
+struct run_state { // shared by a run and its watchdog
+    std::atomic<pid_t> pid {0};
+    std::atomic<int> halt_mode {0};
+};
+
 struct thread_arguments {
     string prog = "";
     string functionName = "";
@@ -541,33 +1227,156 @@ struct thread_arguments {
     int L2 = 0;
     string injectionType = "";
     int numberOfTests = 0;
+    string triggerType = "Breakpoint"; // Breakpoint or Watchpoint
+    string watchCondition = "rw"; // w or rw
+    intptr_t watchAddress = 0; // 0 means a random variable at the injection address
+    int skipCount = 0; // number of watched accesses to let through before injecting
+    uint64_t instructionCount = 0; // 0 means a uniformly random instance of the golden run's instruction count
+    unsigned hitCount = 1; // dynamic execution of the injection address that triggers the fault, 0 for a random one
+    string goldenTrace = ""; // file receiving the basic blocks executed by the golden run
+    block_trace* trace = nullptr; // shared by all threads, written by the golden run only
+    output_capture* capture = nullptr; // drains the output of every debugee
+    golden_output* goldenOut = nullptr; // output of the golden run, filled in before any faulty run starts
+    golden_output* goldenErr = nullptr;
+    bool killOnSdc = false; // stop a faulty run as soon as its output diverges
+    string captureMode = "pipe"; // pipe or memfd
+    double hangFactor = 10; // a faulty run hangs once it has used this many times the golden run's CPU time (or instructions)
+    int hangMinimum = 50; // smallest CPU time budget, in milliseconds
+    bool hangInstructions = false; // budget in instructions instead of CPU time
+    int calibrationRuns = 1; // golden runs made in parallel to measure its duration
+    double timeoutFactor = 3; // a run that makes no progress for this many times the golden run's p99 duration hangs
+    string goldenCache = ""; // file keeping the golden run's measurements between campaigns
+    golden_stats* stats = nullptr; // measured by the golden runs before any faulty run starts
+    bool perfCounters = false; // count instructions and cycles of every run
+    double perfFactor = 3; // a run that uses this many times more of a resource than the golden run's p99 is a performance fault
+    sandbox_profile sandbox; // limits of every debugee
+    string workdir = ""; // parent of the working directories of the runs, they share SOFI's if empty
+    std::vector<string> outputFiles; // files written by the debugee into its working directory, compared with the golden run's
+    std::vector<file_digest>* goldenFiles = nullptr; // filled in by the golden run
+    std::vector<string> checkpoints; // functions whose returns are observation points for masked faults
+    golden_points* goldenPoints = nullptr; // filled in by the two first golden runs, at each observation point
+    std::unordered_set<uint64_t>* goldenStates = nullptr; // hashes of the golden runs' states at their observation points, once masked
+    state_mask* stateMask = nullptr; // what differs between two golden runs, empty during them
+    uint64_t goldenInstructions = 0; // retired by the golden run, known before any faulty run starts
+    int jobs = 0; // faulty runs made in parallel, one per CPU if 0
+    string resultLog = ""; // file receiving a record of every run
+    string heatmap = ""; // CSV file receiving the counters of every source line and function
     long tid;
-    debugger* debuggers;
+    run_state* state = nullptr;
+    result_record* record = nullptr; // filled in at the end of the run
+    worker_profile* profile = nullptr; // of the worker making the run
+    string traceOut = ""; // file receiving a timeline of the phases of every run
+    string metrics = ""; // Unix socket serving live metrics of the campaign
+    uint64_t seed = 0; // of the random choices of every run, drawn from the clock if not given
+    bool seeded = false;
+    trace_buffer* traceBuffer = nullptr; // of the track the run is on, if it's traced
 };
 
-void go() {
-  std::unique_lock<std::mutex> lck(mtx);
-  ready = true;
-  cv.notify_all();
+void check_performance(debugger& dbg, const golden_stats& stats, double factor){ // flags a run that used 'factor' times more of a resource than the golden run
+    const std::pair<const char*, uint64_t> used[] = {
+        {"user", dbg.user_time},
+        {"rss", dbg.max_rss},
+        {"instructions", dbg.counted_instructions},
+        {"cycles", dbg.counted_cycles},
+    };
+    for (const auto& u : used) {
+        auto golden = stats.p99(u.first);
+        if (golden == 0 || u.second == 0) continue; // not measured
+        if (string(u.first) == "user" && u.second < 10000) continue; // a few milliseconds are noise
+        double ratio = static_cast<double>(u.second) / golden;
+        if (ratio > dbg.perf_ratio) {
+            dbg.perf_ratio = ratio;
+            dbg.perf_resource = u.first;
+        }
+    }
+    dbg.perf_fault = dbg.perf_ratio > factor;
+}
+string sdc_location(const result_record& r, const thread_arguments& args){ // where the output first differs from the golden run's
+    if (!r.sdc) return "";
+    if (r.divergence_out >= 0) return " (at byte " + std::to_string(r.divergence_out) + " of cout)";
+    if (r.divergence_err >= 0) return " (at byte " + std::to_string(r.divergence_err) + " of cerr)";
+    if (r.divergence_file >= 0 && static_cast<std::size_t>(r.divergence_file) < args.outputFiles.size()) return " (in " + args.outputFiles[r.divergence_file] + ")";
+    return "";
+}
+result_record make_record(const debugger& dbg, const thread_arguments& args, uint64_t site, unsigned hit){ // what is kept of a run once its debugger is gone
+    result_record r;
+    r.tid = args.tid;
+    r.site = site;
+    r.hit = hit;
+    strncpy(r.fault, args.injectionType.c_str(), sizeof(r.fault) - 1);
+    r.outcome = static_cast<uint8_t>(dbg.outcome);
+    r.halt = dbg.halt_mode;
+    r.sdc = dbg.sdc;
+    r.perf_fault = dbg.perf_fault;
+    r.exit_code = dbg.exit_code;
+    r.signo = dbg.result.si_signo;
+    r.si_code = dbg.result.si_code;
+    r.si_errno = dbg.result.si_errno;
+    for (std::size_t f = 0; f < args.outputFiles.size(); f++) {
+        if (args.outputFiles[f] == dbg.divergence_file) r.divergence_file = f;
+    }
+    r.duration = dbg.duration;
+    r.cpu_time = dbg.cpu_time;
+    r.user_time = dbg.user_time;
+    r.system_time = dbg.system_time;
+    r.max_rss = dbg.max_rss;
+    r.minor_faults = dbg.minor_faults;
+    r.major_faults = dbg.major_faults;
+    r.counted_instructions = dbg.counted_instructions;
+    r.counted_cycles = dbg.counted_cycles;
+    r.instructions = dbg.instructions;
+    r.divergence_out = dbg.divergence_out;
+    r.divergence_err = dbg.divergence_err;
+    r.perf_ratio = dbg.perf_ratio;
+    strncpy(r.perf_resource, dbg.perf_resource.c_str(), sizeof(r.perf_resource) - 1);
+    return r;
+}
+void print_result(const result_record& r, const thread_arguments& args){ // one line per run
+    auto perf = r.perf_fault ? " (" + string(r.perf_resource) + " x" + std::to_string(r.perf_ratio).substr(0, 4) + ")" : "";
+    cout<<"- tid: "<<r.tid<<" - halt: "<<int(r.halt)<<" - duration: "<<r.duration<<" - sdc: "<<int(r.sdc)<<sdc_location(r, args)<<" - perf: "<<int(r.perf_fault)<<perf<<" - cpu: "<<r.cpu_time<<" - rss: "<<r.max_rss<<" - outcome: "<<to_string(static_cast<run_outcome>(r.outcome))<<" - exit: "<<r.exit_code<<" - code: "<<r.si_code<<" - errno: "<<r.si_errno<<" - singno: "<<r.signo<<" - no: "<<strsignal(r.signo)<<endl;
 }
-int get_ttl(int duration, int number_of_tests){ // used to calculate INFINITY value. But, we will be using INFINITY as 10 seconds. If you want to change the value of INFINITY, just change the value inside 'define INFINITY' at the start of the code.
-    return (duration+1)*number_of_tests;
+bool is_golden_run(const thread_arguments& args){ // runs without a fault: the golden run, and those that only measure its duration
+    return args.injectionType == "init" || args.injectionType == "calibrate";
 }
 void set_timeout(int seconds){ // used to emulate halt mode (it puts the thread into sleep)
     std::this_thread::sleep_for(std::chrono::seconds(seconds));
 }
-string convertToString(char* a, int size) { 
-    int i; 
-    string s = ""; 
-    for (i = 0; i < size; i++) { 
-        s = s + a[i]; 
-    } 
-    return s; 
-} 
+long long collect_output_file(int fd, golden_output& golden, bool is_golden) { // maps a memfd the debugee wrote to, returns the divergence offset
+    struct stat st;
+    std::size_t size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    void* map = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED) size = 0;
+
+    if (is_golden) { // the mapping itself becomes the golden output, nothing is copied
+        golden.adopt(size ? static_cast<const char*>(map) : nullptr, size);
+        return -1;
+    }
+    stream_comparator comparator {&golden};
+    if (size) {
+        comparator.feed(static_cast<const char*>(map), size);
+        munmap(map, size);
+    }
+    comparator.end();
+    return comparator.divergence();
+}
+
+bool reaches_callee_of_main(debugger& dbg, const block_trace& trace) { // a check of trace_blocks: a block outside main is in a function of the program
+    for (const auto& b : trace.blocks()) {
+        try {
+            if (at_name(dbg.get_function_from_pc(b.addr)) != "main") return true;
+        }
+        catch (const std::exception&) {} // in no function, e.g. a PLT stub
+    }
+    return false;
+}
+
 void thread_function(void *arguments) { // main function of a thread
     struct thread_arguments *args = (struct thread_arguments *)arguments;
 
     auto start = high_resolution_clock::now(); //used to calculate the runtime duration
+    phase_clock clock {args->traceBuffer != nullptr};
+    clock.enter(phase::pipe_setup);
+    current_counters() = args->profile ? &args->profile->counters : nullptr; // this thread only makes this run
 
     long tid; // thread ID
     tid = args->tid;
@@ -575,42 +1384,133 @@ void thread_function(void *arguments) { // main function of a thread
     int filedesOut[2]; // Used to get std::cout of the debuggee 
     int filedesErr[2]; // Used to get std:cerr of the debuggee
 
-    if (pipe(filedesOut) == -1) { // creation of pipes for communication for cout
+    bool memfd = args->captureMode == "memfd"; // the debugee writes into memory files that are read in place once it exits
+    if (memfd) {
+        filedesOut[0] = filedesErr[0] = -1;
+        filedesOut[1] = memfd_create("sofi-cout", MFD_CLOEXEC);
+        filedesErr[1] = memfd_create("sofi-cerr", MFD_CLOEXEC);
+        if (filedesOut[1] == -1 || filedesErr[1] == -1) {
+            perror("memfd_create");
+            exit(1);
+        }
+    }
+    // close-on-exec, so that debugees forked by other threads don't keep these pipes open
+    else if (pipe2(filedesOut, O_CLOEXEC) == -1) { // creation of pipes for communication for cout
         perror("pipe");
         exit(1);
     }
-    if (pipe(filedesErr) == -1) { // creation of pipes for communication for cerr
+    else if (pipe2(filedesErr, O_CLOEXEC) == -1) { // creation of pipes for communication for cerr
         perror("pipe");
         exit(1);
     }
     /* Set O_NONBLOCK flag for the read end (pfd[0]) of the pipe. */
-    if (fcntl(filedesOut[0], F_SETFL, O_NONBLOCK) == -1) { // for cout
+    else if (fcntl(filedesOut[0], F_SETFL, O_NONBLOCK) == -1) { // for cout
         fprintf(stderr, "Call to fcntl failed.\n");
         exit(1);
     }
-     if (fcntl(filedesErr[0], F_SETFL, O_NONBLOCK) == -1) { // for cerr
+    else if (fcntl(filedesErr[0], F_SETFL, O_NONBLOCK) == -1) { // for cerr
         fprintf(stderr, "Call to fcntl failed.\n");
         exit(1);
     }
 
-    auto pid = fork();
+    run_cgroup cgroup; // outlives the debugee, which is reaped before the end of this function
+    if (args->sandbox.cgroup != "" && !cgroup.create(args->sandbox, "sofi-" + std::to_string(getpid()) + "-" + std::to_string(tid))) {
+        cerr << "Cannot create a cgroup in " << args->sandbox.cgroup << endl;
+    }
+
+    run_directory dir; // emptied and removed once the debugee is gone
+    if (args->workdir != "" && !dir.create(args->workdir, "run-" + std::to_string(tid))) {
+        cerr << "Cannot create a working directory in " << args->workdir << endl;
+    }
+
+    clock.enter(phase::fork_exec);
+    auto pid = cgroup.fork_into();
     if (pid == 0) { // child will become the debuggee
         //child
         while ((dup2(filedesOut[1], STDOUT_FILENO) == -1) && (errno == EINTR)) {}
         while ((dup2(filedesErr[1], STDERR_FILENO) == -1) && (errno == EINTR)) {}
-        close(filedesOut[0]);
-        close(filedesErr[0]);
+        if (!memfd) {
+            close(filedesOut[0]);
+            close(filedesErr[0]);
+        }
+        if (dir.is_created() && chdir(dir.path().c_str()) == -1) {
+            _exit(127);
+        }
         personality(ADDR_NO_RANDOMIZE); // to remove address randomization
-        execute_debugee(args->prog); // begin debuggee (execl)
+        execute_debugee(args->prog, args->sandbox); // begin debuggee (execl)
+        _exit(127); // exec failed, the copy of SOFI must not carry on
     }
     else if (pid >= 1)  {
         //parent
         // std::cout << "Start process " << pid << " on thread "<<tid<<endl;
+        output_capture::handle out, err;
+        if (!memfd) { // drained for the whole run, and compared with the golden output on the fly by faulty runs
+            close(filedesOut[1]);
+            close(filedesErr[1]);
+            auto compared = !is_golden_run(*args);
+            out = args->capture->add(filedesOut[0], compared ? args->goldenOut : nullptr, args->killOnSdc ? pid : 0);
+            err = args->capture->add(filedesErr[0], compared ? args->goldenErr : nullptr, args->killOnSdc ? pid : 0);
+        }
+
+        clock.enter(phase::symbol_resolution);
         debugger dbg{args->prog, pid};
+        dbg.clock = &clock;
+        dbg.seed(args->seed, tid);
+        dbg.enter(phase::first_stop);
         dbg.run(); // run debugger
-        args->debuggers[tid] = dbg; // store thread's debugger object to the thread
+        args->state->pid = pid; // watched from now on
+        dbg.enter(phase::symbol_resolution);
+
+        perf_counter instructionCounter, cycleCounter; // whole run, for performance faults
+        if (args->perfCounters) {
+            if (instructionCounter.open(dbg.m_pid, 0, PERF_COUNT_HW_INSTRUCTIONS)) instructionCounter.enable();
+            if (cycleCounter.open(dbg.m_pid, 0, PERF_COUNT_HW_CPU_CYCLES)) cycleCounter.enable();
+        }
         // debugger& dbg = (args->debuggers[tid]);
 
+        std::vector<intptr_t> checkpoints; // entries of the checkpoint functions
+        for (const auto& name : args->checkpoints) {
+            try {
+                checkpoints.push_back(dbg.offset_dwarf_address(at_low_pc(dbg.get_function_from_name(name))));
+            }
+            catch (const std::exception&) {
+                if (args->injectionType == "init") cerr << "Cannot find checkpoint function " << name << endl;
+            }
+        }
+        if (!checkpoints.empty()) { // at the same point of every run
+            dbg.fix_random_bytes(); // or no two runs would have the same canaries
+            if (soft_dirty_supported()) dbg.clear_dirty_pages();
+        }
+        auto fingerprint = [&](item_contents* contents) { // state of the debugee and everything it has output so far, at an observation point
+            auto items = dbg.read_state(*args->stateMask, contents);
+            uint64_t key = n_registers + 1, hash; // below any page address
+            auto mix = [&](uint64_t value) { hash = fnv1a(reinterpret_cast<const char*>(&value), sizeof(value), hash); };
+            for (auto fd : {filedesOut, filedesErr}) {
+                hash = fnv1a(nullptr, 0);
+                if (memfd) {
+                    auto d = digest_file(fd[1]);
+                    mix(d.size);
+                    mix(d.hash);
+                }
+                else {
+                    auto s = args->capture->snapshot(fd == filedesOut ? out : err);
+                    mix(s.first);
+                    mix(s.second);
+                }
+                items.push_back({key++, hash});
+            }
+            for (const auto& file : args->outputFiles) {
+                hash = fnv1a(nullptr, 0);
+                auto d = dir.digest(file);
+                mix(d.exists);
+                mix(d.size);
+                mix(d.hash);
+                items.push_back({key++, hash});
+            }
+            std::sort(items.begin(), items.end());
+            return items;
+        };
+
         intptr_t addr1;
         intptr_t addr2;
         intptr_t addr;
@@ -618,113 +1518,536 @@ void thread_function(void *arguments) { // main function of a thread
         if(args->inputType == 1){ // inject errors using source lines
             dbg.get_address_at_source_line(args->fileName, args->L1, addr1);
             dbg.get_address_at_source_line(args->fileName, args->L2, addr2);
-            addr = addr1 + rand() % ((addr2 - addr1) +1);
-            dbg.get_alligned_address(addr);
+            addr = addr1 + dbg.random() % ((addr2 - addr1) +1);
+            dbg.get_alligned_address(addr, addr1, addr2);
         }
         else if (args->inputType == 2){ // inject errors using function name
             dbg.get_function_start_and_end_addresses(args->functionName,addr1, addr2);
-            addr = addr1 + rand() % ((addr2 - addr1) +1);
-            dbg.get_alligned_address(addr);
+            addr = addr1 + dbg.random() % ((addr2 - addr1) +1);
+            dbg.get_alligned_address(addr, addr1, addr2);
         }
 
-        if (args->injectionType == "Opcode"){ // Opcode error injection
-            dbg.mutate_opcode(addr);
+        uint64_t site = 0; // where the fault was injected, and on which execution
+        unsigned siteHit = 0;
+        try { // the injection may throw, e.g. on variables the DWARF expressions don't cover
+            unsigned hit = args->hitCount;
+            if (!is_golden_run(*args) && args->trace != nullptr && !args->trace->empty()) { // only inject into code that runs
+                dbg.pick_executed_address(*args->trace, addr1, addr2, addr, hit);
+            }
+            if (hit == 0) hit = 1;
+
+            if (args->triggerType == "Instructions" && !is_golden_run(*args)){ // inject at the N-th retired instruction
+                uint64_t count = args->instructionCount;
+                if (count == 0 && args->goldenInstructions > 0) {
+                    uint64_t random = (static_cast<uint64_t>(dbg.random()) << 31) | dbg.random();
+                    count = 1 + random % args->goldenInstructions;
+                }
+                if (dbg.run_to_instruction(count)) {
+                    dbg.enter(phase::fault_apply);
+                    site = dbg.get_pc();
+                    if (args->injectionType == "Opcode"){
+                        dbg.mutate_opcode(dbg.get_pc());
+                    }
+                    else if (args->injectionType == "Register"){
+                        dbg.corrupt_register();
+                    }
+                    else if (args->injectionType == "Data"){
+                        dbg.corrupt_memory(dbg.get_registers().rsp); // variables may be out of reach of the DWARF info here
+                    }
+                }
+            }
+            else if (args->triggerType == "Watchpoint" && !is_golden_run(*args)){ // inject on the first dynamic access to a variable
+                intptr_t watchAddr = args->watchAddress;
+                auto cond = args->watchCondition == "w" ? watch_condition::write : watch_condition::read_write;
+                if (dbg.run_to_data_access(addr, watchAddr, cond, args->skipCount)) {
+                    dbg.enter(phase::fault_apply);
+                    site = dbg.get_pc(); // just past the access
+                    if (args->injectionType == "Opcode"){
+                        dbg.mutate_opcode(dbg.get_pc());
+                    }
+                    else if (args->injectionType == "Register"){
+                        dbg.corrupt_register();
+                    }
+                    else if (args->injectionType == "Data"){
+                        dbg.corrupt_memory(watchAddr);
+                    }
+                }
+            }
+            else if (args->injectionType == "Opcode"){ // Opcode error injection
+                site = addr;
+                siteHit = hit;
+                if (hit == 1) {
+                    dbg.enter(phase::fault_apply);
+                    dbg.mutate_opcode(addr);
+                }
+                else if (dbg.run_to_breakpoint(addr, hit)) { // the hit-th execution and later ones see the mutated opcode
+                    dbg.enter(phase::fault_apply);
+                    dbg.mutate_opcode(addr);
+                }
+            }
+            else if (args->injectionType == "Register"){ // mutation inside random registers error injection
+                site = addr;
+                siteHit = hit;
+                dbg.mutate_register(addr, hit);
+            }
+            else if (args->injectionType == "Data"){// random data corruption error injection
+                site = addr;
+                siteHit = hit;
+                dbg.mutate_data(addr, hit);
+            }
+            else if (args->injectionType == "init"){
+                // cout<<"golden code: "<<tid<<endl;
+            }
+            else if (args->injectionType == "test"){ // for testing purposes
+                if(tid == 5){
+                    set_timeout(15);
+                }
+            }
         }
-        else if (args->injectionType == "Register"){ // mutation inside random registers error injection
-            dbg.mutate_register(addr);
+        catch (const std::exception& e) {
+            cerr << "tid " << tid << ": " << e.what() << endl;
+            dbg.kill_and_reap();
+            dbg.outcome = run_outcome::aborted;
         }
-        else if (args->injectionType == "Data"){// random data corruption error injection
-            dbg.mutate_data(addr);        
+
+        dbg.enter(phase::post_fault_run);
+        perf_counter goldenCounter; // measures the golden run for the instruction count trigger
+        if (args->injectionType == "init" && (args->triggerType == "Instructions" || args->hangInstructions) && goldenCounter.open(dbg.m_pid)) {
+            goldenCounter.enable();
         }
-        else if (args->injectionType == "init"){
-            // cout<<"golden code: "<<tid<<endl;
+
+        if (args->injectionType == "init" && args->trace != nullptr) { // golden run recording its basic blocks
+            dbg.trace_blocks(*args->trace);
+            if (!reaches_callee_of_main(dbg, *args->trace)) {
+                cerr << "The golden run's trace never left main: injections are only drawn from main's blocks" << endl;
+            }
+            if (args->goldenTrace != "" && !args->trace->save(args->goldenTrace)) {
+                cerr << "Cannot write " << args->goldenTrace << endl;
+            }
         }
-        else if (args->injectionType == "test"){ // for testing purposes
-            if(tid == 5){
-                set_timeout(15);
+        if (!checkpoints.empty() && dbg.outcome == run_outcome::running) {
+            if (args->goldenPoints != nullptr) { // one of the two golden runs recording their states
+                while (dbg.run_to_function_exit(checkpoints)) {
+                    args->goldenPoints->states.push_back(fingerprint(&args->goldenPoints->contents));
+                }
+            }
+            else if (!is_golden_run(*args)) { // stops at the first one the golden run also had: the fault is masked from there on
+                while (dbg.run_to_function_exit(checkpoints)) {
+                    if (args->goldenStates->count(hash_state(fingerprint(nullptr), args->stateMask->items))) {
+                        dbg.kill_and_reap();
+                        dbg.outcome = run_outcome::masked;
+                        break;
+                    }
+                }
+            }
+        }
+        if (dbg.outcome == run_outcome::running) {
+            dbg.run_to_exit();
+        }
+        dbg.kill_and_reap(); // no-op unless something went wrong on the way
+        dbg.enter(phase::classification);
+        if (goldenCounter.is_open()) {
+            dbg.instructions = goldenCounter.read();
+        }
+        if (instructionCounter.is_open()) { // final counts stay readable once the debugee is gone
+            dbg.counted_instructions = instructionCounter.read();
+        }
+        if (cycleCounter.is_open()) {
+            dbg.counted_cycles = cycleCounter.read();
+        }
+        if (args->state->halt_mode != 0) {
+            dbg.outcome = run_outcome::timeout;
+        }
+        else if (dbg.outcome == run_outcome::fatal_signal || dbg.outcome == run_outcome::exit_code) { // did the sandbox stop it?
+            auto signo = dbg.result.si_signo;
+            if (cgroup.memory_limit_hit()) {
+                dbg.outcome = run_outcome::memory_limit;
+            }
+            else if (cgroup.pids_limit_hit()) {
+                dbg.outcome = run_outcome::pids_limit;
+            }
+            else if (args->sandbox.cpu_seconds && (signo == SIGXCPU || (signo == SIGKILL && dbg.cpu_time >= args->sandbox.cpu_seconds * 1000000))) {
+                dbg.outcome = run_outcome::cpu_limit;
             }
         }
-        
-        close(filedesOut[1]);
-        close(filedesErr[1]);
-
-        char bufferOut[BUFFER_SIZE]; // used to store cout
-        char bufferErr[BUFFER_SIZE]; // used to store cerr
 
-        dbg.step_over_breakpoint();
-        ptrace(PTRACE_CONT, dbg.m_pid, nullptr, nullptr);
-        dbg.result = dbg.wait_for_signal();
+        auto stop = high_resolution_clock::now(); 
+        auto duration = duration_cast<microseconds>(stop - start); 
+        dbg.duration = duration.count();
 
-        if(args->debuggers[tid].halt_mode == 0 && dbg.result.si_code == 0 && dbg.result.si_signo == 0 && dbg.result.si_errno == 0){
+        dbg.enter(phase::output_drain);
+        if(args->injectionType == "calibrate"){ // only measured
+        }
+        else if(dbg.outcome == run_outcome::masked){ // its output would have been the golden run's
+        }
+        else if(args->state->halt_mode == 0 && (dbg.outcome == run_outcome::exited || dbg.outcome == run_outcome::exit_code)){
             // cout<<tid<<" enter"<<endl;
-            auto stop = high_resolution_clock::now(); 
-            auto duration = duration_cast<seconds>(stop - start); 
-            dbg.duration = duration.count();
-            dbg.ttl = get_ttl(dbg.duration, args->numberOfTests);
-            // cout<<tid<<" check1 "<<endl;
-            ssize_t countOut = read(filedesOut[0], bufferOut, sizeof(bufferOut));
-            ssize_t countErr = read(filedesErr[0], bufferErr, sizeof(bufferErr));
-            dbg.originalOut = convertToString(bufferOut, countOut);
-            dbg.originalErr = convertToString(bufferErr, countErr);
-            // cout<<tid<<" check2 "<<endl;
-            if(args->debuggers[0].originalOut != dbg.originalOut){
-                dbg.sdc = 1;
+            if(memfd){
+                dbg.divergence_out = collect_output_file(filedesOut[1], *args->goldenOut, args->injectionType == "init");
+                dbg.divergence_err = collect_output_file(filedesErr[1], *args->goldenErr, args->injectionType == "init");
+                dbg.sdc = dbg.divergence_out >= 0 || dbg.divergence_err >= 0;
             }
-            else if(args->debuggers[0].originalErr != dbg.originalErr){
-                dbg.sdc = 1;
+            else if(args->injectionType == "init"){
+                dbg.originalOut = args->capture->finish(out);
+                dbg.originalErr = args->capture->finish(err);
+                args->goldenOut->assign(dbg.originalOut);
+                args->goldenErr->assign(dbg.originalErr);
+            }
+            else {
+                args->capture->finish(out);
+                args->capture->finish(err);
+                dbg.divergence_out = out->comparator.divergence();
+                dbg.divergence_err = err->comparator.divergence();
+                dbg.sdc = out->comparator.diverged() || err->comparator.diverged();
+            }
+            for(std::size_t f = 0; f < args->outputFiles.size(); f++){ // output files are part of the output
+                auto digest = dir.digest(args->outputFiles[f]);
+                if(args->injectionType == "init"){
+                    args->goldenFiles->push_back(digest);
+                }
+                else if(f >= args->goldenFiles->size()){ // the golden run didn't exit cleanly: no reference to compare with
+                    break;
+                }
+                else if(digest != (*args->goldenFiles)[f] && dbg.divergence_file == ""){
+                    dbg.divergence_file = args->outputFiles[f];
+                    dbg.sdc = 1;
+                }
+            }
+            if(args->injectionType != "init"){
+                dbg.enter(phase::classification);
+                check_performance(dbg, *args->stats, args->perfFactor);
             }
             // cout<<tid<<" quit"<<endl;
 
         }
-        else if (args->debuggers[tid].halt_mode != 0){
+        else if (args->state->halt_mode != 0){
             dbg.halt_mode = 1;
         }
-        close(filedesOut[0]);
-        close(filedesErr[0]);
+        else if (!memfd && WIFSIGNALED(dbg.m_wait_status) && WTERMSIG(dbg.m_wait_status) == SIGKILL){
+            args->capture->discard(out); // under the capture's lock: the comparators are no longer fed after it
+            args->capture->discard(err);
+            if (out->comparator.diverged() || err->comparator.diverged()) { // killed by --kill-on-sdc
+                dbg.divergence_out = out->comparator.divergence();
+                dbg.divergence_err = err->comparator.divergence();
+                dbg.sdc = 1;
+            }
+        }
+        if (memfd) {
+            close(filedesOut[1]);
+            close(filedesErr[1]);
+        }
+        else {
+            args->capture->discard(out); // no-op if the output was collected
+            args->capture->discard(err);
+            close(filedesOut[0]);
+            close(filedesErr[0]);
+        }
 
-        args->debuggers[tid] = dbg;
-        // cout<<"Exit pid "<<pid<<" and thread "<<tid<<" duration "<<args->debuggers[tid].duration<<endl;
+        dbg.enter(phase::classification);
+        *args->record = make_record(dbg, *args, site ? dbg.offset_load_address(site) : 0, siteHit);
+        clock.stop();
+        if (args->profile) clock.record(*args->profile);
+        if (args->traceBuffer) {
+            args->traceBuffer->add_run(tid, pid, args->record->site, to_string(dbg.outcome) + (dbg.sdc ? ", sdc" : ""), clock);
+        }
+        // cout<<"Exit pid "<<pid<<" and thread "<<tid<<" duration "<<dbg.duration<<endl;
+    }
+    else {
+        perror("Cannot start the debugee");
+        exit(1);
     }
-
 }
 
 
-void *thread_function_init(void *arguments) { // function used while initializing the threads 
-    struct thread_arguments *args = (struct thread_arguments *)arguments;
-
+void run_with_watchdog(thread_arguments* args) { // one run, killed if it hangs
     // The below lines of code are used to set timeout on the thread's execution in a graceful way (clean way).
-    // if the running time becomes bigger than INFINITY, the debugee will stop on executing, and the debugger wil consider that we are in halt mode.
-    if(args->tid){
-        std::unique_lock<std::mutex> lck(mtx);
-        while (!ready) cv.wait(lck);
-    }
+    // A faulty run that uses more CPU time (or instructions) than 'hangFactor' times the golden run, or that makes no progress for 'timeoutFactor'
+    // times the golden run's p99 duration, is killed and the debugger considers that we are in halt mode.
 
     // function used to execute the main fuction of the thread.
-    std::future<void> future = std::async(std::launch::async, [arguments](){ 
-        thread_function(arguments);
+    std::future<void> future = std::async(std::launch::async, [args](){ 
+        thread_function(args);
     }); 
  
+    uint64_t budget = stall_seconds * 1000000ull; // golden runs get stall_seconds of CPU time, and of no progress
+    uint64_t stall = stall_seconds * 1000000ull;
+    bool instructions = false;
+    if (args->injectionType == "init" && args->trace != nullptr) { // recording its basic blocks, a stop per branch
+        budget *= 100;
+        stall *= 100;
+    }
+    if (!is_golden_run(*args)) {
+        uint64_t minimum = args->hangMinimum * 1000ull;
+        instructions = args->hangInstructions && args->goldenInstructions > 0;
+        budget = instructions ? args->goldenInstructions * args->hangFactor
+                              : std::max<uint64_t>(args->stats->p99("cpu") * args->hangFactor, minimum);
+        stall = std::max<uint64_t>(args->stats->p99("duration") * args->timeoutFactor, minimum);
+    }
+    // sampled often enough to kill an infinite loop soon after its budget is spent
+    auto interval = std::chrono::microseconds(std::min<uint64_t>(std::max<uint64_t>(budget / 10, 1000), 10000));
+    if (instructions) interval = std::chrono::milliseconds(1);
+
+    hang_detector detector;
     std::future_status status;
     bool timeout_done = false;
     do {
-        if(args->debuggers[0].ttl<INFINITY){
-            status = future.wait_for(std::chrono::seconds(args->debuggers[0].ttl));
-        }
-        else {
-            status = future.wait_for(std::chrono::seconds(INFINITY));
-        }
+        status = future.wait_for(interval);
         if (status == std::future_status::deferred) {
             // std::cout << "deferred\n";
-        } else if (status == std::future_status::timeout && !timeout_done) {
-            timeout_done = true;
-            args->debuggers[args->tid].halt_mode = 1;
-            kill((args->debuggers[args->tid]).m_pid, SIGTRAP);
-            // std::cout << "timeout thread "<<args->tid<<"...\n";
+        } else if (status == std::future_status::timeout && !timeout_done && args->state->pid > 0) {
+            if (!detector.is_attached()) {
+                detector.attach(args->state->pid, budget, std::chrono::microseconds(stall), instructions);
+            }
+            if (detector.hung()) {
+                timeout_done = true;
+                args->state->halt_mode = 1;
+                kill(args->state->pid, SIGKILL); // the thread sees the debugee die and reaps it
+                // std::cout << "timeout thread "<<args->tid<<"...\n";
+            }
         } else if (status == std::future_status::ready) {
             // std::cout << "ready!\n";
         }
     } while (status != std::future_status::ready ); 
-    go();
+}
+
+void *thread_function_init(void *arguments) { // a golden run, in a thread of its own
+    run_with_watchdog((struct thread_arguments *)arguments);
+    pthread_exit(NULL);
+}
+
+struct campaign { // the faulty runs, shared by the workers and the result writer
+    thread_arguments* args; // what every run starts from
+    std::atomic<long> next {1}; // tid of the next run to start
+    std::atomic<bool> done {false}; // no more results will come
+    mpsc_queue<result_record, 1024> results;
+    result_log log;
+    const site_table* sites = nullptr; // where faults can be injected
+    site_stats* siteStats = nullptr; // what they led to there
+    worker_profile* profiles = nullptr; // one per worker, after the golden runs' at index 0
+    int jobs = 0;
+    std::atomic<int> nextProfile {1};
+    trace_buffer* traces = nullptr; // one per worker, if the runs are traced
+    steady_clock::time_point start = steady_clock::now(); // live counters, read by the metrics server without any lock:
+    std::atomic<int> active {0}; // runs in progress
+    std::atomic<uint64_t> completed {0};
+    std::atomic<uint64_t> outcomes[static_cast<int>(run_outcome::masked) + 1] {};
+    std::atomic<uint64_t> sdcs {0};
+    std::atomic<uint64_t> perfFaults {0};
+    std::atomic<uint64_t> timeouts {0};
+};
+
+std::atomic<bool> profileRequested {false}; // set by SIGUSR1
+
+std::unique_ptr<worker_profile> merge_profiles(const worker_profile* profiles, int n){ // readable while the workers still add to them
+    std::unique_ptr<worker_profile> total {new worker_profile};
+    for (int i = 0; i < n; i++) {
+        total->merge(profiles[i]);
+    }
+    return total;
+}
+
+void print_profile(const worker_profile* profiles, int n){ // where the tracer spends its time, added up over the profiles
+    auto total = merge_profiles(profiles, n);
+    auto runs = std::max<uint64_t>(total->runs, 1);
+    auto micros = [](uint64_t ns) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << ns / 1000.0;
+        return out.str();
+    };
+    const auto& c = total->counters;
+    cout<<"Tracer profile: "<<total->runs<<" run(s) - ptrace calls/run: "<<c.ptrace_calls / runs<<" - waits/run: "<<c.waits / runs
+        <<" - bytes read/run: "<<c.bytes_read / runs<<" - bytes written/run: "<<c.bytes_written / runs<<endl;
+    for (std::size_t p = 0; p < n_phases; p++) {
+        const auto& h = total->phases[p];
+        if (h.count() == 0) continue;
+        cout<<"- "<<to_string(static_cast<phase>(p))<<" - runs: "<<h.count()<<" - mean: "<<micros(h.sum() / h.count())<<" us - p50: "<<micros(h.quantile(0.5))
+            <<" us - p90: "<<micros(h.quantile(0.9))<<" us - p99: "<<micros(h.quantile(0.99))<<" us - max: "<<micros(h.max())<<" us"<<endl;
+    }
+    for (int i = 0; i < n; i++) {
+        const auto& w = profiles[i];
+        cout<<"- "<<(i == 0 ? string("golden runs") : "worker " + std::to_string(i))<<" - runs: "<<w.runs<<" - ptrace calls: "<<w.counters.ptrace_calls
+            <<" - waits: "<<w.counters.waits<<" - bytes read: "<<w.counters.bytes_read<<" - bytes written: "<<w.counters.bytes_written<<endl;
+    }
+}
+
+void count_site(campaign& c, const result_record& r) { // adds a faulty run to the counters of the site it was injected at
+    long site = c.siteStats && r.site ? c.sites->find(r.site) : -1;
+    if (site < 0) return;
+    auto& s = *c.siteStats;
+    auto outcome = static_cast<run_outcome>(r.outcome);
+    s.add(site, site_stats::injections);
+    if (r.sdc) {
+        s.add(site, site_stats::sdc);
+    }
+    else if (r.halt || outcome == run_outcome::timeout || outcome == run_outcome::cpu_limit) {
+        s.add(site, site_stats::hang);
+    }
+    else if (outcome == run_outcome::fatal_signal) {
+        s.add(site, site_stats::crash);
+        s.add(site, site_stats::signal_counter(r.signo));
+    }
+    else if (outcome == run_outcome::exited || outcome == run_outcome::masked) {
+        s.add(site, site_stats::masked);
+    }
+    else {
+        s.add(site, site_stats::detected);
+    }
+    if (r.perf_fault) {
+        s.add(site, site_stats::perf_fault);
+    }
+}
+
+string percent(double rate){
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << rate * 100 << "%";
+    return out.str();
+}
+
+void print_heatmap(const site_table& sites, const site_stats& stats, const string& csv){ // counters of the sites, added up by source line and by function
+    std::map<std::pair<uint32_t, uint32_t>, std::pair<uint32_t, site_summary>> lines; // by file and line, with the line's function
+    std::map<string, site_summary> functions;
+    for (std::size_t i = 0; i < sites.size(); i++) {
+        if (stats.get(i, site_stats::injections) == 0) continue;
+        auto& line = lines[{sites[i].file, sites[i].line}];
+        line.first = sites[i].function;
+        line.second.add(stats, i);
+        functions[sites.function(sites[i].function)].add(stats, i);
+    }
+    if (lines.empty()) return;
+
+    std::ofstream out;
+    if (csv != "") {
+        out.open(csv);
+        out << "kind,file,line,function,injections,masked,sdc,crash,hang,detected,perf_fault,segv,bus,ill,fpe,abrt,trap,other_signal,"
+            << "sdc_rate,sdc_low,sdc_high,crash_rate,crash_low,crash_high" << endl;
+    }
+    auto print = [&](const string& kind, const string& file, uint32_t line, const string& function, const site_summary& s) {
+        rate_interval sdc {s[site_stats::sdc], s[site_stats::injections]};
+        rate_interval crash {s[site_stats::crash], s[site_stats::injections]};
+        cout<<"- "<<(kind == "line" ? file + ":" + std::to_string(line) + " (" + function + ")" : function)<<" - injections: "<<s[site_stats::injections]
+            <<" - masked: "<<s[site_stats::masked]<<" - sdc: "<<s[site_stats::sdc]<<" - crash: "<<s[site_stats::crash]<<" - hang: "<<s[site_stats::hang]
+            <<" - detected: "<<s[site_stats::detected]<<" - perf: "<<s[site_stats::perf_fault]
+            <<" - sdc rate: "<<percent(sdc.rate)<<" ["<<percent(sdc.low)<<", "<<percent(sdc.high)<<"]"
+            <<" - crash rate: "<<percent(crash.rate)<<" ["<<percent(crash.low)<<", "<<percent(crash.high)<<"]"<<endl;
+        if (out.is_open()) {
+            out << kind << "," << file << "," << (kind == "line" ? std::to_string(line) : "") << "," << function;
+            for (int c = 0; c < site_stats::n_counters; c++) {
+                out << "," << s.counts[c];
+            }
+            out << "," << sdc.rate << "," << sdc.low << "," << sdc.high << "," << crash.rate << "," << crash.low << "," << crash.high << endl;
+        }
+    };
+
+    cout<<"Vulnerability by source line (rates with 95% confidence intervals):"<<endl;
+    for (const auto& l : lines) {
+        print("line", sites.file(l.first.first), l.first.second, sites.function(l.second.first), l.second.second);
+    }
+    cout<<"Vulnerability by function:"<<endl;
+    for (const auto& f : functions) {
+        print("function", "", 0, f.first, f.second);
+    }
+    if (csv != "" && !out) {
+        cerr << "Cannot write " << csv << endl;
+    }
+}
+
+string metrics_text(const campaign& c){ // live state of the campaign, in the Prometheus text format
+    std::ostringstream out;
+    auto metric = [&](const char* name, const char* type, const char* help) {
+        out<<"# HELP "<<name<<" "<<help<<"\n# TYPE "<<name<<" "<<type<<"\n";
+    };
+    auto seconds = duration_cast<duration<double>>(steady_clock::now() - c.start).count();
+    uint64_t completed = c.completed;
+    metric("sofi_injections_total", "counter", "Faulty runs that are over.");
+    out<<"sofi_injections_total "<<completed<<"\n";
+    metric("sofi_injections_per_second", "gauge", "Faulty runs over per second, since the first one started.");
+    out<<"sofi_injections_per_second "<<(seconds > 0 ? completed / seconds : 0)<<"\n";
+    metric("sofi_outcomes_total", "counter", "Faulty runs by outcome.");
+    for (int o = 0; o <= static_cast<int>(run_outcome::masked); o++) {
+        if (o != static_cast<int>(run_outcome::running)) {
+            out<<"sofi_outcomes_total{outcome=\""<<to_string(static_cast<run_outcome>(o))<<"\"} "<<c.outcomes[o]<<"\n";
+        }
+    }
+    metric("sofi_sdc_total", "counter", "Faulty runs with a silent data corruption.");
+    out<<"sofi_sdc_total "<<c.sdcs<<"\n";
+    metric("sofi_perf_faults_total", "counter", "Faulty runs with a performance fault.");
+    out<<"sofi_perf_faults_total "<<c.perfFaults<<"\n";
+    metric("sofi_timeout_ratio", "gauge", "Share of the faulty runs over that hung.");
+    out<<"sofi_timeout_ratio "<<(completed ? static_cast<double>(c.timeouts) / completed : 0)<<"\n";
+    metric("sofi_active_tracees", "gauge", "Faulty runs in progress.");
+    out<<"sofi_active_tracees "<<c.active<<"\n";
+    metric("sofi_result_queue_depth", "gauge", "Results waiting for the writer.");
+    out<<"sofi_result_queue_depth "<<c.results.size()<<"\n";
+
+    auto total = merge_profiles(c.profiles, c.jobs + 1);
+    metric("sofi_phase_latency_seconds", "summary", "Time spent in each phase of a run, golden runs included.");
+    for (std::size_t p = 0; p < n_phases; p++) {
+        const auto& h = total->phases[p];
+        auto name = to_string(static_cast<phase>(p));
+        for (double q : {0.5, 0.9, 0.99}) {
+            out<<"sofi_phase_latency_seconds{phase=\""<<name<<"\",quantile=\""<<q<<"\"} "<<h.quantile(q) / 1e9<<"\n";
+        }
+        out<<"sofi_phase_latency_seconds_sum{phase=\""<<name<<"\"} "<<h.sum() / 1e9<<"\n";
+        out<<"sofi_phase_latency_seconds_count{phase=\""<<name<<"\"} "<<h.count()<<"\n";
+    }
+    metric("sofi_ptrace_calls_total", "counter", "ptrace calls made by the tracer.");
+    out<<"sofi_ptrace_calls_total "<<total->counters.ptrace_calls<<"\n";
+    metric("sofi_tracer_bytes_total", "counter", "Bytes of debugee memory and registers read and written by the tracer.");
+    out<<"sofi_tracer_bytes_total{direction=\"read\"} "<<total->counters.bytes_read<<"\n";
+    out<<"sofi_tracer_bytes_total{direction=\"written\"} "<<total->counters.bytes_written<<"\n";
+    return out.str();
+}
+
+void *worker_function(void *arguments) { // makes faulty runs one after the other until there are none left
+    auto c = static_cast<campaign*>(arguments);
+    run_state state;
+    result_record record;
+    auto worker = c->nextProfile++;
+    auto profile = &c->profiles[worker];
+    for (long tid = c->next++; tid <= c->args->numberOfTests; tid = c->next++) {
+        thread_arguments args = *c->args;
+        args.tid = tid;
+        state.pid = 0;
+        state.halt_mode = 0;
+        record = result_record{};
+        record.tid = tid;
+        args.state = &state;
+        args.record = &record;
+        args.profile = profile;
+        args.traceBuffer = c->traces ? &c->traces[worker - 1] : nullptr;
+        c->active++;
+        run_with_watchdog(&args);
+        c->active--;
+        c->outcomes[record.outcome]++;
+        if (record.sdc) c->sdcs++;
+        if (record.perf_fault) c->perfFaults++;
+        if (record.halt || record.outcome == static_cast<uint8_t>(run_outcome::timeout)) c->timeouts++;
+        c->completed++;
+        count_site(*c, record);
+        c->results.push(record);
+    }
+    pthread_exit(NULL);
+}
+
+void *writer_function(void *arguments) { // the only consumer of the results: logs and prints them as they come
+    auto c = static_cast<campaign*>(arguments);
+    result_record r;
+    while (true) {
+        bool done = c->done; // before popping, so that nothing pushed before it is left behind
+        if (c->results.try_pop(r)) {
+            if (c->log.is_open() && !c->log.append(r)) {
+                cerr << "Cannot write " << c->args->resultLog << endl;
+                c->log.close();
+            }
+            print_result(r, *c->args);
+            continue;
+        }
+        if (profileRequested.exchange(false)) {
+            print_profile(c->profiles, c->jobs + 1);
+        }
+        if (done) break;
+        std::this_thread::sleep_for(1ms);
+    }
     pthread_exit(NULL);
 }
 void print_header(){ // SOFI header
@@ -745,17 +2068,209 @@ void print_header(){ // SOFI header
     <<"MMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMM"<<endl
     <<endl;
 }
+void print_usage(const char* name){
+    cout<<"Usage: "<<name<<" [options]"<<endl
+        <<"  --trigger=breakpoint|watchpoint|icount"<<endl
+        <<"                                   inject at a code address (default), on a data access or after N instructions"<<endl
+        <<"  --watch=w|rw                     access that fires a watchpoint trigger (default rw)"<<endl
+        <<"  --watch-addr=ADDR                watch ADDR instead of a random variable at the injection address"<<endl
+        <<"  --skip=N                         let N watched accesses through before injecting"<<endl
+        <<"  --icount=N                       inject after N instructions instead of a random count of the golden run"<<endl
+        <<"  --hit=K|random                   inject on the K-th execution of the injection address (default 1)"<<endl
+        <<"  --golden-trace=FILE              record the basic blocks executed by the golden run into FILE,"<<endl
+        <<"                                   and only inject into executed blocks"<<endl
+        <<"  --kill-on-sdc                    stop a faulty run as soon as its output differs from the golden run"<<endl
+        <<"  --capture=pipe|memfd             drain output through pipes (default) or let debugees write to memory files"<<endl
+        <<"  --hang-factor=F                  a faulty run hangs after F times the golden run's CPU time (default 10)"<<endl
+        <<"  --hang-min=MS                    smallest CPU time budget of a faulty run, in milliseconds (default 50)"<<endl
+        <<"  --hang-counter=cpu|icount        budget in CPU time (default) or in retired instructions"<<endl
+        <<"  --calibrate=K                    measure the golden run over K runs in parallel (default 1)"<<endl
+        <<"  --timeout-factor=F               a faulty run that makes no progress for F times the golden run's p99 duration hangs (default 3)"<<endl
+        <<"  --golden-cache=FILE              keep the golden run's measurements in FILE, and reuse them until the program changes"<<endl
+        <<"  --perf-counters                  count the instructions and cycles of every run"<<endl
+        <<"  --perf-factor=F                  a run using F times more of a resource than the golden run is a performance fault (default 3)"<<endl
+        <<"  --core-dumps                     let crashing debugees dump core"<<endl
+        <<"  --limit-cpu=S                    CPU time limit of a debugee, in seconds"<<endl
+        <<"  --limit-as=MB                    address space limit of a debugee, in megabytes"<<endl
+        <<"  --cgroup=DIR                     run every debugee in a cgroup of its own, created in the cgroup v2 directory DIR"<<endl
+        <<"  --memory-max=MB                  memory.max of these cgroups, in megabytes (swap is disabled)"<<endl
+        <<"  --pids-max=N                     pids.max of these cgroups"<<endl
+        <<"  --workdir=DIR                    run every debugee in an empty working directory of its own, created in DIR"<<endl
+        <<"  --output-file=FILE               compare FILE, written by the debugee into its working directory, with the golden run's"<<endl
+        <<"                                   (can be repeated, the working directories default to /dev/shm)"<<endl
+        <<"  --jobs=N                         faulty runs made in parallel (default: one per CPU)"<<endl
+        <<"  --results=FILE                   log a fixed-size record of every run into FILE as it ends"<<endl
+        <<"  --heatmap=FILE                   write the outcomes of the faults by source line and by function into the CSV file FILE"<<endl
+        <<"  --read-results=FILE              print the runs logged in FILE, and exit"<<endl
+        <<"  --checkpoint=FUNC                stop a faulty run as masked when its state on a return of FUNC is one the golden run had"<<endl
+        <<"                                   (can be repeated)"<<endl
+        <<"  --trace-out=FILE                 write a timeline of the phases of every run into FILE, in the Chrome trace event format"<<endl
+        <<"  --seed=N                         seed of the random choices, to make the same campaign again (printed with the golden run)"<<endl
+        <<"  --metrics=SOCKET                 serve live metrics of the campaign in the Prometheus text format on the Unix socket SOCKET"<<endl;
+}
+void parse_options(int argc, char* argv[], thread_arguments& args){ // options that are not asked for interactively
+    for(int i = 1; i < argc; i++){
+        string opt = argv[i];
+        auto eq = opt.find('=');
+        string name = opt.substr(0, eq);
+        string value = eq == string::npos ? "" : opt.substr(eq + 1);
+
+        if(name == "--trigger" && (value == "breakpoint" || value == "watchpoint" || value == "icount")){
+            args.triggerType = value == "breakpoint" ? "Breakpoint" : value == "watchpoint" ? "Watchpoint" : "Instructions";
+        }
+        else if(name == "--watch" && (value == "w" || value == "rw")){
+            args.watchCondition = value;
+        }
+        else if(name == "--watch-addr" && value != ""){
+            args.watchAddress = std::stoll(value, 0, 0);
+        }
+        else if(name == "--skip" && value != ""){
+            args.skipCount = std::stoi(value);
+        }
+        else if(name == "--hit" && value == "random"){
+            args.hitCount = 0;
+        }
+        else if(name == "--hit" && value != "" && std::stoi(value) > 0){
+            args.hitCount = std::stoi(value);
+        }
+        else if(name == "--golden-trace" && value != ""){
+            args.goldenTrace = value;
+        }
+        else if(name == "--capture" && (value == "pipe" || value == "memfd")){
+            args.captureMode = value;
+        }
+        else if(name == "--hang-factor" && value != "" && std::stod(value) > 0){
+            args.hangFactor = std::stod(value);
+        }
+        else if(name == "--hang-min" && value != ""){
+            args.hangMinimum = std::stoi(value);
+        }
+        else if(name == "--hang-counter" && (value == "cpu" || value == "icount")){
+            args.hangInstructions = value == "icount";
+        }
+        else if(name == "--calibrate" && value != "" && std::stoi(value) > 0){
+            args.calibrationRuns = std::stoi(value);
+        }
+        else if(name == "--timeout-factor" && value != "" && std::stod(value) > 0){
+            args.timeoutFactor = std::stod(value);
+        }
+        else if(name == "--golden-cache" && value != ""){
+            args.goldenCache = value;
+        }
+        else if(name == "--perf-counters" && eq == string::npos){
+            args.perfCounters = true;
+        }
+        else if(name == "--perf-factor" && value != "" && std::stod(value) > 0){
+            args.perfFactor = std::stod(value);
+        }
+        else if(name == "--core-dumps" && eq == string::npos){
+            args.sandbox.core_dumps = true;
+        }
+        else if(name == "--limit-cpu" && value != ""){
+            args.sandbox.cpu_seconds = std::stoull(value);
+        }
+        else if(name == "--limit-as" && value != ""){
+            args.sandbox.address_space = std::stoull(value) << 20;
+        }
+        else if(name == "--cgroup" && value != ""){
+            args.sandbox.cgroup = value;
+        }
+        else if(name == "--memory-max" && value != ""){
+            args.sandbox.memory_max = std::stoull(value) << 20;
+        }
+        else if(name == "--pids-max" && value != ""){
+            args.sandbox.pids_max = std::stoull(value);
+        }
+        else if(name == "--workdir" && value != ""){
+            args.workdir = value;
+        }
+        else if(name == "--output-file" && value != ""){
+            args.outputFiles.push_back(value);
+        }
+        else if(name == "--jobs" && value != "" && std::stoi(value) > 0){
+            args.jobs = std::stoi(value);
+        }
+        else if(name == "--results" && value != ""){
+            args.resultLog = value;
+        }
+        else if(name == "--heatmap" && value != ""){
+            args.heatmap = value;
+        }
+        else if(name == "--trace-out" && value != ""){
+            args.traceOut = value;
+        }
+        else if(name == "--metrics" && value != ""){
+            args.metrics = value;
+        }
+        else if(name == "--seed" && value != ""){
+            args.seed = std::stoull(value, 0, 0);
+            args.seeded = true;
+        }
+        else if(name == "--read-results" && value != ""){
+            bool valid = result_log::read(value, [&](const result_record& r) { print_result(r, args); });
+            if (!valid) cerr << "Cannot read " << value << endl;
+            exit(valid ? 0 : 1);
+        }
+        else if(name == "--checkpoint" && value != ""){
+            args.checkpoints.push_back(value);
+        }
+        else if(name == "--kill-on-sdc" && eq == string::npos){
+            args.killOnSdc = true;
+        }
+        else if(name == "--icount" && value != ""){
+            args.instructionCount = std::stoull(value);
+        }
+        else{
+            print_usage(argv[0]);
+            exit(name == "--help" ? 0 : 1);
+        }
+    }
+}
+#ifndef SOFI_NO_MAIN // the benchmarks link SOFI's code without its main
 int main(int argc, char* argv[]) { // main function for program SOFI.
-    print_header(); // prints the SOFI title.
-    srand(time(0)); // to enable random fault injections.
-
     thread_arguments init_vars; // arguments used during thread initialization.
+    parse_options(argc, argv, init_vars);
+
+    print_header(); // prints the SOFI title.
+    if (!init_vars.seeded) { // to enable random fault injections.
+        init_vars.seed = std::random_device{}() ^ static_cast<uint64_t>(time(0)) << 32;
+    }
 
     do{
         cout    << "Please enter name of the program that you want to debug..." << endl;
         cin     >> init_vars.prog;
     }while(init_vars.prog == "");
 
+    char* prog = realpath(init_vars.prog.c_str(), nullptr); // the debugee may be started from its own directory, and its mappings are named by their real path
+    if (prog) {
+        init_vars.prog = prog;
+        free(prog);
+    }
+    run_directory workdirs; // parent of the working directories of the runs
+    std::vector<file_digest> goldenFiles;
+    std::unordered_set<uint64_t> goldenStates;
+    state_mask stateMask;
+    if (init_vars.workdir == "" && !init_vars.outputFiles.empty()) {
+        init_vars.workdir = "/dev/shm"; // a tmpfs, so that output files never reach a disk
+    }
+    if (init_vars.workdir != "") {
+        if (!workdirs.create(init_vars.workdir, "sofi-" + std::to_string(getpid()))) {
+            cerr << "Cannot create a working directory in " << init_vars.workdir << endl;
+            exit(1);
+        }
+        init_vars.workdir = workdirs.path();
+    }
+    if (init_vars.sandbox.cgroup != "") {
+        auto missing = missing_controllers(init_vars.sandbox);
+        if (missing != "") { // memory.max or pids.max would be ignored
+            cerr << "Enable the" << missing << " controller(s) in " << init_vars.sandbox.cgroup << "/cgroup.subtree_control" << endl;
+            exit(1);
+        }
+    }
+    init_vars.goldenFiles = &goldenFiles;
+    init_vars.goldenStates = &goldenStates;
+    init_vars.stateMask = &stateMask;
+
     do{
         cout    << "Please enter how you want to inject..." << endl;
         cout    << "Between lines L1 and L2 ?[1] or inside a function f ?[2]";
@@ -791,26 +2306,151 @@ int main(int argc, char* argv[]) { // main function for program SOFI.
         cin     >>  init_vars.numberOfTests;
     }while(init_vars.numberOfTests<0);
 
+    golden_stats stats;
+    bool cached = init_vars.goldenCache != "" && stats.load(init_vars.goldenCache, init_vars.prog);
+    bool traced = init_vars.goldenTrace != "" || init_vars.hitCount == 0; // the first golden run records its basic blocks, far slower
+    int goldenRuns = cached ? 1 : init_vars.calibrationRuns + (traced ? 1 : 0); // the first one keeps the golden output, the others are only measured
+    bool compared = !traced && !init_vars.checkpoints.empty(); // the two first golden runs record their states, to find what differs from run to run
+    if (compared) goldenRuns = std::max(goldenRuns, 2);
+    init_vars.stats = &stats;
+    int jobs = init_vars.jobs ? init_vars.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::max(1, std::min(jobs, init_vars.numberOfTests));
+    std::unique_ptr<worker_profile[]> profiles {new worker_profile[jobs + 1]}; // the golden runs', then one per worker
+    struct sigaction usr1 {};
+    usr1.sa_handler = [](int) { profileRequested = true; };
+    usr1.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &usr1, nullptr); // prints the tracer profile so far
+    std::vector<trace_buffer> traces; // the golden runs' tracks, then the workers'
+    std::vector<string> trackNames;
+    if (init_vars.traceOut != "") {
+        traces.resize(goldenRuns + jobs);
+        for (int t = 0; t < goldenRuns + jobs; t++) {
+            trackNames.push_back(t == 0 ? "golden run" : t < goldenRuns ? "calibration " + std::to_string(t) : "worker " + std::to_string(t - goldenRuns + 1));
+        }
+    }
+
     int rc;
     int i;
-    pthread_t* threads = new pthread_t[init_vars.numberOfTests + 1]; // creation of threads that will handle the fault injections.
-    debugger* debuggers = new debugger[init_vars.numberOfTests + 1]; // To each thread, we have his own debugger object that will be handling the fault injection.
+    pthread_t* threads = new pthread_t[goldenRuns]; // the golden runs, all in parallel. The first one keeps the golden output, the others only measure it
     pthread_attr_t attr;
     void *status;
-    init_vars.debuggers = debuggers;
-    thread_arguments* init_vars_arr = new thread_arguments[init_vars.numberOfTests + 1];
+    output_capture capture;
+    golden_output goldenOut, goldenErr;
+    init_vars.capture = &capture;
+    init_vars.goldenOut = &goldenOut;
+    init_vars.goldenErr = &goldenErr;
+    if (traced) {
+        init_vars.trace = new block_trace;
+        if (!init_vars.checkpoints.empty()) {
+            cerr << "Checkpoints are ignored while the golden run records its basic blocks" << endl;
+        }
+    }
+    std::vector<thread_arguments> goldenArgs(goldenRuns, init_vars);
+    std::vector<run_state> goldenRunStates(goldenRuns);
+    std::vector<result_record> goldenRecords(goldenRuns);
+    golden_points goldenPoints[2];
 
     // Initialize and set thread joinable
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
-    for( i = 0; i < init_vars.numberOfTests + 1; i++ ) { // Create the threads.
-        init_vars_arr[i] = init_vars;
+    for( i = 0; i < goldenRuns; i++ ) { // Create the threads.
         if(i == 0){ // this iteration is made for the golden execution, to get the correct output data (for SDC ~ silent data corruption)
-            init_vars_arr[i].injectionType = "init";
+            goldenArgs[i].injectionType = "init";
+            goldenArgs[i].tid = 0;
         }
-        init_vars_arr[i].tid = i;
-        rc = pthread_create(&threads[i], &attr, thread_function_init, (void *)&(init_vars_arr[i]));
+        else{ // a golden execution that only measures its duration
+            goldenArgs[i].injectionType = "calibrate";
+            goldenArgs[i].tid = init_vars.numberOfTests + i;
+        }
+        goldenArgs[i].state = &goldenRunStates[i];
+        goldenArgs[i].record = &goldenRecords[i];
+        goldenArgs[i].profile = &profiles[0];
+        goldenArgs[i].traceBuffer = traces.empty() ? nullptr : &traces[i];
+        goldenArgs[i].goldenPoints = compared && i < 2 ? &goldenPoints[i] : nullptr;
+        goldenRecords[i].tid = goldenArgs[i].tid;
+        rc = pthread_create(&threads[i], &attr, thread_function_init, (void *)&goldenArgs[i]);
+        if (rc) {
+            cout << "Error:unable to create thread," << rc << endl;
+            exit(-1);
+        }
+    }
+    for( i = 0; i < goldenRuns; i++ ) {
+        pthread_join(threads[i], &status);
+        const auto& run = goldenRecords[i];
+        if(!cached && run.halt == 0 && !(traced && i == 0)){ // a traced run measures the tracing
+            stats.add("duration", run.duration);
+            stats.add("cpu", run.cpu_time);
+            stats.add("user", run.user_time);
+            stats.add("system", run.system_time);
+            stats.add("rss", run.max_rss);
+            stats.add("minor_faults", run.minor_faults);
+            stats.add("major_faults", run.major_faults);
+            if(init_vars.perfCounters){
+                stats.add("instructions", run.counted_instructions);
+                stats.add("cycles", run.counted_cycles);
+            }
+        }
+    }
+    if(!cached){
+        stats.summarize();
+        if(init_vars.goldenCache != "" && !stats.save(init_vars.goldenCache, init_vars.prog)){
+            cerr << "Cannot write " << init_vars.goldenCache << endl;
+        }
+    }
+    cout<<"Golden run: "<<stats.runs()<<(cached ? " cached" : "")<<" run(s), duration p50 "<<stats.p50("duration")<<" us, p99 "<<stats.p99("duration")
+        <<" us, CPU time p99 "<<stats.p99("cpu")<<" us, max RSS p99 "<<stats.p99("rss")<<" kB, seed "<<init_vars.seed<<endl;
+    delete[] threads;
+    if (compared) { // what differs between the two golden runs at any observation point isn't compared, on any of them
+        auto n = std::min(goldenPoints[0].states.size(), goldenPoints[1].states.size());
+        for (std::size_t k = 0; k < n; k++) volatile_items(goldenPoints[0], goldenPoints[1], k, stateMask);
+        std::size_t words = 0;
+        for (auto& item : stateMask.words) {
+            std::sort(item.second.begin(), item.second.end());
+            item.second.erase(std::unique(item.second.begin(), item.second.end()), item.second.end());
+            words += item.second.size();
+        }
+        for (auto& run : goldenPoints) {
+            for (std::size_t k = 0; k < run.states.size(); k++) goldenStates.insert(golden_state(run, k, stateMask));
+            run = golden_points{}; // the contents are no longer needed
+        }
+        cout<<"Checkpoints: "<<n<<" observation point(s), "<<stateMask.items.size()<<" item(s) and "<<words
+            <<" word(s) differing between two golden runs"<<endl;
+    }
+
+    campaign faulty; // then the faulty runs, by a pool of workers, their results streamed to the writer
+    init_vars.goldenInstructions = goldenRecords[0].instructions;
+    faulty.args = &init_vars;
+    site_table sites; // the heatmap's
+    try {
+        int fd = open(init_vars.prog.c_str(), O_RDONLY);
+        elf::elf ef {elf::create_mmap_loader(fd)};
+        sites.load(dwarf::dwarf{dwarf::elf::create_loader(ef)});
+    }
+    catch (const std::exception& e) {
+        cerr << "No heatmap: " << e.what() << endl;
+    }
+    site_stats siteStats {sites.size()};
+    faulty.sites = &sites;
+    faulty.siteStats = &siteStats;
+    if (init_vars.resultLog != "" && !faulty.log.open(init_vars.resultLog)) {
+        cerr << "Cannot write " << init_vars.resultLog << endl;
+    }
+    faulty.profiles = profiles.get();
+    faulty.jobs = jobs;
+    faulty.traces = traces.empty() ? nullptr : &traces[goldenRuns];
+    faulty.start = steady_clock::now(); // before the metrics thread reads it
+    metrics_server metricsServer;
+    if (init_vars.metrics != "" && !metricsServer.start(init_vars.metrics, [&faulty] { return metrics_text(faulty); })) {
+        cerr << "Cannot serve metrics on " << init_vars.metrics << endl;
+    }
+    pthread_t writer;
+    std::vector<pthread_t> workers(jobs);
+    cout<<"***********************************************************"<<endl; // Print results
+    faulty.results.push(goldenRecords[0]);
+    pthread_create(&writer, &attr, writer_function, (void *)&faulty);
+    for( i = 0; i < jobs; i++ ) {
+        rc = pthread_create(&workers[i], &attr, worker_function, (void *)&faulty);
         if (rc) {
             cout << "Error:unable to create thread," << rc << endl;
             exit(-1);
@@ -819,23 +2459,28 @@ int main(int argc, char* argv[]) { // main function for program SOFI.
 
     // free attribute and wait for the other threads
     pthread_attr_destroy(&attr);
-    for( i = 0; i < init_vars.numberOfTests + 1; i++ ) {
-        rc = pthread_join(threads[i], &status);
+    for( i = 0; i < jobs; i++ ) {
+        rc = pthread_join(workers[i], &status);
         if (rc) {
             cout << "Error:unable to join," << rc << endl;
             exit(-1);
         }
-        // cout << "Main: completed thread id :" << i ;
-        // cout << "  exiting with status :" << status << endl;
-    }
-    cout<<"***********************************************************"<<endl; // Print results
-    for(int i=0; i<init_vars.numberOfTests + 1; i++){
-        cout<<"- tid: "<<i<<" - halt: "<<debuggers[i].halt_mode<<" - duration: "<<debuggers[i].duration<<" - sdc: "<<debuggers[i].sdc<<" - code: "<<debuggers[i].result.si_code<<" - errno: "<<debuggers[i].result.si_code<<" - singno: "<<debuggers[i].result.si_signo<<" - no: "<<strsignal(debuggers[i].result.si_signo)<<endl;
     }
+    faulty.done = true;
+    pthread_join(writer, &status);
+    metricsServer.stop();
+    faulty.log.close();
     cout<<"***********************************************************"<<endl;
+    print_heatmap(sites, siteStats, init_vars.heatmap);
+    print_profile(profiles.get(), jobs + 1);
+    if (init_vars.traceOut != "" && !write_chrome_trace(init_vars.traceOut, traces, trackNames)) {
+        cerr << "Cannot write " << init_vars.traceOut << endl;
+    }
 
+    workdirs.remove();
     cout << "Main: program exiting." << endl;
     pthread_exit(NULL);
 
     return 0;
 }
+#endif
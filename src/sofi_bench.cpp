@@ -0,0 +1,303 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "elf/elf++.hh"
+#include "dwarf/dwarf++.hh"
+#include "result_log.hpp"
+
+using namespace sofi;
+using namespace std;
+using namespace std::chrono;
+
+/*
+End-to-end benchmark of SOFI: fixed-seed campaigns over the examples/bench workloads, at 1, 2, 4 ... N workers and in every
+execution mode asked for, each run as a separate SOFI process so that its CPU time and peak RSS can be told apart.
+The numbers come from SOFI's own result log, they are printed as a table and written as CSV and JSON for regression tracking.
+*/
+
+struct workload {
+    string name; // target, without its bench_ prefix
+    string function; // injected into
+    string checkpoint; // returns only a few times, "" if no function does
+    vector<string> options; // what SOFI needs to run it
+};
+
+struct measurement {
+    string workload;
+    string mode;
+    int jobs = 0;
+    uint64_t injections = 0; // faulty runs logged
+    double seconds = 0; // wall clock time of the campaign, golden run included
+    double rate = 0; // injections per second
+    uint64_t p50 = 0; // duration of a faulty run, in microseconds
+    uint64_t p99 = 0;
+    double tracerShare = 0; // SOFI's part of the CPU time of the campaign, the rest being the debugees'
+    uint64_t peakRss = 0; // of SOFI itself, in kilobytes
+    uint64_t misplaced = 0; // injection sites outside of the workload's function
+    bool ok = false;
+};
+
+struct options {
+    string sofi = ""; // defaults to the directory of this executable
+    string benchDir = "";
+    vector<string> workloads {"matmul", "quicksort", "hashmap", "crc", "parser", "reducer", "writer"};
+    vector<string> modes {"pipe", "memfd"};
+    string injectionType = "Register";
+    int injections = 32;
+    int maxJobs = 0;
+    uint64_t seed = 1;
+    string csv = "";
+    string json = "";
+};
+
+vector<workload> known_workloads(){
+    return {
+        {"matmul", "multiply", "multiply", {}},
+        {"quicksort", "partition", "", {}},
+        {"hashmap", "find", "grow", {}},
+        {"crc", "crc32", "compress", {}},
+        {"parser", "term", "", {}},
+        {"long_loop", "step", "", {}},
+        {"reducer", "reduce", "", {}},
+        {"writer", "write_records", "write_records", {"--output-file=bench_writer.out"}},
+    };
+}
+
+vector<string> mode_options(const string& mode, const workload& w){ // execution modes of SOFI
+    if (mode == "pipe") return {"--capture=pipe"}; // exec per run, output drained through pipes
+    if (mode == "memfd") return {"--capture=memfd"}; // exec per run, output read in place once the debugee exits
+    if (mode == "checkpoint" && w.checkpoint != "") return {"--capture=pipe", "--checkpoint=" + w.checkpoint}; // stops masked runs early
+    return {};
+}
+
+vector<string> split(const string& list){
+    vector<string> items;
+    std::stringstream in {list};
+    string item;
+    while (getline(in, item, ',')) {
+        if (item != "") items.push_back(item);
+    }
+    return items;
+}
+
+string directory_of_executable(){
+    char path[4096];
+    auto n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (n <= 0) return ".";
+    string exe {path, static_cast<size_t>(n)};
+    return exe.substr(0, exe.rfind('/'));
+}
+
+uint64_t peak_rss(pid_t pid){ // VmHWM of a running process, in kilobytes
+    std::ifstream status {"/proc/" + std::to_string(pid) + "/status"};
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::stoull(line.substr(6));
+    }
+    return 0;
+}
+
+pair<uint64_t, uint64_t> function_range(const string& path, const string& function){ // DWARF [low_pc, high_pc), {0, 0} if not found
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return {0, 0};
+    try {
+        elf::elf ef {elf::create_mmap_loader(fd)};
+        dwarf::dwarf dw {dwarf::elf::create_loader(ef)};
+        for (const auto& cu : dw.compilation_units()) {
+            for (const auto& die : cu.root()) {
+                if (die.tag == dwarf::DW_TAG::subprogram && die.has(dwarf::DW_AT::name) && dwarf::at_name(die) == function
+                    && die.has(dwarf::DW_AT::low_pc)) {
+                    return {dwarf::at_low_pc(die), dwarf::at_high_pc(die)};
+                }
+            }
+        }
+    }
+    catch (const std::exception&) {} // no usable DWARF
+    return {0, 0};
+}
+
+uint64_t percentile(vector<uint64_t> values, double p){ // nearest rank
+    if (values.empty()) return 0;
+    sort(values.begin(), values.end());
+    auto rank = static_cast<size_t>(p * values.size() + 0.999999);
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+measurement run_campaign(const options& opts, const workload& w, const string& mode, int jobs){ // one SOFI process
+    measurement m;
+    m.workload = w.name;
+    m.mode = mode;
+    m.jobs = jobs;
+    string log = "/tmp/sofi_bench-" + std::to_string(getpid()) + ".log";
+    vector<string> args {opts.sofi, "--jobs=" + std::to_string(jobs), "--seed=" + std::to_string(opts.seed), "--results=" + log};
+    for (const auto& o : mode_options(mode, w)) args.push_back(o);
+    for (const auto& o : w.options) args.push_back(o);
+    string input = opts.benchDir + "/bench_" + w.name + "\n2\n" + w.function + "\n" + opts.injectionType + "\n" + std::to_string(opts.injections) + "\n";
+
+    int in[2];
+    if (pipe2(in, O_CLOEXEC) == -1) return m;
+    auto start = steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(in[0], STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        vector<char*> argv;
+        for (auto& a : args) argv.push_back(&a[0]);
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(in[0]);
+    if (pid < 0) {
+        close(in[1]);
+        return m;
+    }
+    if (write(in[1], input.data(), input.size()) < 0) {}
+    close(in[1]);
+
+    int status = 0;
+    rusage usage {};
+    while (true) { // VmHWM only grows: its last value is the peak
+        auto rss = peak_rss(pid);
+        if (rss) m.peakRss = rss;
+        auto r = wait4(pid, &status, WNOHANG, &usage);
+        if (r == pid || (r == -1 && errno != EINTR)) break;
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+    m.seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+    vector<uint64_t> durations;
+    uint64_t debugeeCpu = 0;
+    auto range = function_range(opts.benchDir + "/bench_" + w.name, w.function); // where every injection must be
+    bool logged = result_log::read(log, [&](const result_record& r) {
+        debugeeCpu += r.cpu_time;
+        if (r.tid != 0) durations.push_back(r.duration);
+        if (r.tid != 0 && r.site != 0 && (r.site < range.first || r.site >= range.second)) ++m.misplaced;
+    });
+    unlink(log.c_str());
+    // usage covers SOFI and every debugee it reaped
+    uint64_t totalCpu = usage.ru_utime.tv_sec * 1000000ull + usage.ru_utime.tv_usec + usage.ru_stime.tv_sec * 1000000ull + usage.ru_stime.tv_usec;
+    m.injections = durations.size();
+    m.rate = m.seconds > 0 ? m.injections / m.seconds : 0;
+    m.p50 = percentile(durations, 0.5);
+    m.p99 = percentile(durations, 0.99);
+    m.tracerShare = totalCpu > debugeeCpu ? static_cast<double>(totalCpu - debugeeCpu) / totalCpu : 0;
+    if (m.misplaced) cerr << w.name << ": " << m.misplaced << " injection(s) outside of " << w.function << endl;
+    m.ok = logged && WIFEXITED(status) && WEXITSTATUS(status) == 0 && m.injections == static_cast<uint64_t>(opts.injections) && !m.misplaced;
+    return m;
+}
+
+void write_csv(const string& path, const vector<measurement>& results){
+    std::ofstream out {path};
+    out << "workload,mode,jobs,injections,seconds,injections_per_second,p50_us,p99_us,tracer_cpu_share,peak_rss_kb,ok" << endl;
+    for (const auto& m : results) {
+        out << m.workload << "," << m.mode << "," << m.jobs << "," << m.injections << "," << m.seconds << "," << m.rate << ","
+            << m.p50 << "," << m.p99 << "," << m.tracerShare << "," << m.peakRss << "," << (m.ok ? 1 : 0) << endl;
+    }
+    if (!out) cerr << "Cannot write " << path << endl;
+}
+
+void write_json(const string& path, const options& opts, const vector<measurement>& results){
+    std::ofstream out {path};
+    out << "{\"seed\":" << opts.seed << ",\"injections\":" << opts.injections << ",\"type\":\"" << opts.injectionType << "\",\"results\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& m = results[i];
+        out << (i ? "," : "") << "\n{\"workload\":\"" << m.workload << "\",\"mode\":\"" << m.mode << "\",\"jobs\":" << m.jobs
+            << ",\"injections\":" << m.injections << ",\"seconds\":" << m.seconds << ",\"injections_per_second\":" << m.rate
+            << ",\"p50_us\":" << m.p50 << ",\"p99_us\":" << m.p99 << ",\"tracer_cpu_share\":" << m.tracerShare
+            << ",\"peak_rss_kb\":" << m.peakRss << ",\"ok\":" << (m.ok ? "true" : "false") << "}";
+    }
+    out << "\n]}" << endl;
+    if (!out) cerr << "Cannot write " << path << endl;
+}
+
+void print_usage(const char* name){
+    cout<<"Usage: "<<name<<" [options]"<<endl
+        <<"  --sofi=PATH                      SOFI executable (default: next to this one)"<<endl
+        <<"  --bench-dir=DIR                  directory of the bench_* workloads (default: next to this one)"<<endl
+        <<"  --workloads=A,B,...              workloads to run (default: matmul,quicksort,hashmap,crc,parser,reducer,writer; also long_loop)"<<endl
+        <<"  --modes=A,B,...                  execution modes to compare: pipe, memfd, checkpoint (default: pipe,memfd),"<<endl
+        <<"                                   checkpoint only with workloads that have a function returning a few times"<<endl
+        <<"  --type=Register|Data|Opcode      injection type (default Register)"<<endl
+        <<"  --injections=K                   faulty runs per campaign (default 32)"<<endl
+        <<"  --max-jobs=N                     run with 1, 2, 4 ... N workers (default: one per CPU)"<<endl
+        <<"  --seed=S                         seed of every campaign (default 1)"<<endl
+        <<"  --csv=FILE                       write the results into the CSV file FILE"<<endl
+        <<"  --json=FILE                      write the results into the JSON file FILE"<<endl;
+}
+
+int main(int argc, char* argv[]) {
+    options opts;
+    for (int i = 1; i < argc; i++) {
+        string opt = argv[i];
+        auto eq = opt.find('=');
+        string name = opt.substr(0, eq);
+        string value = eq == string::npos ? "" : opt.substr(eq + 1);
+        if (name == "--sofi" && value != "") opts.sofi = value;
+        else if (name == "--bench-dir" && value != "") opts.benchDir = value;
+        else if (name == "--workloads" && value != "") opts.workloads = split(value);
+        else if (name == "--modes" && value != "") opts.modes = split(value);
+        else if (name == "--type" && value != "") opts.injectionType = value;
+        else if (name == "--injections" && value != "") opts.injections = std::max(1, std::stoi(value));
+        else if (name == "--max-jobs" && value != "") opts.maxJobs = std::stoi(value);
+        else if (name == "--seed" && value != "") opts.seed = std::stoull(value, 0, 0);
+        else if (name == "--csv" && value != "") opts.csv = value;
+        else if (name == "--json" && value != "") opts.json = value;
+        else {
+            print_usage(argv[0]);
+            return opt == "--help" ? 0 : 1;
+        }
+    }
+    auto here = directory_of_executable();
+    if (opts.sofi == "") opts.sofi = here + "/sofi";
+    if (opts.benchDir == "") opts.benchDir = here;
+    if (opts.maxJobs <= 0) opts.maxJobs = std::max(1u, std::thread::hardware_concurrency());
+    vector<int> jobs;
+    for (int j = 1; j < opts.maxJobs; j *= 2) jobs.push_back(j);
+    jobs.push_back(opts.maxJobs);
+
+    vector<measurement> results;
+    cout<<left<<setw(10)<<"workload"<<setw(11)<<"mode"<<right<<setw(5)<<"jobs"<<setw(11)<<"inj/s"<<setw(11)<<"p50 us"<<setw(11)<<"p99 us"
+        <<setw(9)<<"tracer"<<setw(11)<<"rss kB"<<endl;
+    for (const auto& name : opts.workloads) {
+        auto known = known_workloads();
+        auto w = find_if(known.begin(), known.end(), [&](const workload& k) { return k.name == name; });
+        if (w == known.end()) {
+            cerr << "Unknown workload " << name << endl;
+            continue;
+        }
+        for (const auto& mode : opts.modes) {
+            if (mode_options(mode, *w).empty()) {
+                if (mode != "checkpoint") cerr << "Unknown mode " << mode << endl;
+                continue;
+            }
+            for (int j : jobs) {
+                auto m = run_campaign(opts, *w, mode, j);
+                results.push_back(m);
+                cout<<left<<setw(10)<<m.workload<<setw(11)<<m.mode<<right<<setw(5)<<m.jobs<<fixed<<setprecision(1)<<setw(11)<<m.rate
+                    <<setw(11)<<m.p50<<setw(11)<<m.p99<<setw(8)<<m.tracerShare * 100<<"%"<<setw(11)<<m.peakRss<<(m.ok ? "" : "  (failed)")<<endl;
+            }
+        }
+    }
+    if (opts.csv != "") write_csv(opts.csv, results);
+    if (opts.json != "") write_json(opts.json, opts, results);
+    return all_of(results.begin(), results.end(), [](const measurement& m) { return m.ok; }) ? 0 : 1;
+}